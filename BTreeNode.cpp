@@ -180,9 +180,7 @@ void BTreeStat::save() {
 BTreeInterior::BTreeInterior(HeapFile &file, BlockID block_id, const KeyProfile& key_profile, bool create)
         : BTreeNode(file, block_id, key_profile, create), first(0), pointers(), boundaries() {
     if (!create) {
-        RecordIDs *record_id_list = this->block->ids();
-        RecordID i = 1;
-        for (auto j = record_id_list->size(); j > 0; j--) {
+        for (RecordID i: *this->block) {
             if (i == 1) {
                 // first pointer
                 this->first = get_block_id(i);
@@ -194,9 +192,7 @@ BTreeInterior::BTreeInterior(HeapFile &file, BlockID block_id, const KeyProfile&
                 KeyValue *key_value = get_key(i);
                 this->boundaries.push_back(key_value);
             }
-            i++;
         }
-        delete record_id_list;
     }
 }
 
@@ -309,6 +305,7 @@ Insertion BTreeInterior::insert(const KeyValue* boundary, BlockID block_id) {
 
         // save everything
         nnode->save();
+        delete nnode;
         this->save();
         return ret;
     }
@@ -323,20 +320,18 @@ Insertion BTreeInterior::insert(const KeyValue* boundary, BlockID block_id) {
 BTreeLeaf::BTreeLeaf(HeapFile &file, BlockID block_id, const KeyProfile& key_profile, bool create)
         : BTreeNode(file, block_id, key_profile, create), next_leaf(0), key_map() {
     if (!create) {
-        RecordIDs *record_id_list = this->block->ids();
-        RecordID i = 1;
-        for (auto j = record_id_list->size(); j > 0; j--) {
-            if (i == record_id_list->size()) {
+        RecordID last = this->block->size();
+        for (RecordID i: *this->block) {
+            if (i == last) {
                 // next leaf block
                 this->next_leaf = get_block_id(i);
             } else if (i%2 == 0) {
                 // record i-1: handle, record i: key
                 KeyValue *key_value = get_key(i);
                 this->key_map[*key_value] = get_handle(i-1);
+                delete key_value;
             }
-            i++;
         }
-        delete record_id_list;
     }
 }
 
@@ -432,9 +427,11 @@ Insertion BTreeLeaf::insert(const KeyValue* key, Handle handle) {
             i++;
         }
 
+        BlockID nleaf_id = nleaf->id;
         nleaf->save();
+        delete nleaf;
         this->save();
-        return Insertion(nleaf->id, boundary);
+        return Insertion(nleaf_id, boundary);
     }
 }
 
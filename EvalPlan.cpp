@@ -1,4 +1,8 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 #include "EvalPlan.h"
+#include "schema_tables.h"
 
 
 class Dummy : public DbRelation {
@@ -16,28 +20,38 @@ public:
     virtual Handles* select() {return nullptr;};
     virtual Handles* select(const ValueDict* where) {return nullptr;}
     virtual Handles* select(Handles* current_selection, const ValueDict* where) {return nullptr;}
-    virtual ValueDict* project(Handle handle) {return nullptr;}
-    virtual ValueDict* project(Handle handle, const ColumnNames* column_names) {return nullptr;}
+    virtual Row* project(Handle handle) {return nullptr;}
+    virtual Row* project(Handle handle, const RowSchema& columns) {return nullptr;}
 };
 
 EvalPlan::EvalPlan(PlanType type, EvalPlan *relation)
-        : type(type), relation(relation), projection(nullptr), select_conjunction(nullptr), table(Dummy::one()) {
+        : type(type), relation(relation), projection(nullptr), select_conjunction(nullptr), table(Dummy::one()),
+          index(nullptr), index_key(nullptr), estimated_rows(-1), estimated_cost(-1), considered() {
 }
 
 EvalPlan::EvalPlan(ColumnNames *projection, EvalPlan *relation)
-        : type(Project), relation(relation), projection(projection), select_conjunction(nullptr), table(Dummy::one()) {
+        : type(Project), relation(relation), projection(projection), select_conjunction(nullptr), table(Dummy::one()),
+          index(nullptr), index_key(nullptr), estimated_rows(-1), estimated_cost(-1), considered() {
 }
 
 EvalPlan::EvalPlan(ValueDict* conjunction, EvalPlan *relation)
-        : type(Select), relation(relation), projection(nullptr), select_conjunction(conjunction), table(Dummy::one()) {
+        : type(Select), relation(relation), projection(nullptr), select_conjunction(conjunction), table(Dummy::one()),
+          index(nullptr), index_key(nullptr), estimated_rows(-1), estimated_cost(-1), considered() {
 }
 
 EvalPlan::EvalPlan(DbRelation &table)
-        : type(TableScan), relation(nullptr), projection(nullptr), select_conjunction(nullptr), table(table) {
+        : type(TableScan), relation(nullptr), projection(nullptr), select_conjunction(nullptr), table(table),
+          index(nullptr), index_key(nullptr), estimated_rows(-1), estimated_cost(-1), considered() {
+}
+
+EvalPlan::EvalPlan(DbIndex &index, ValueDict *key, DbRelation &table)
+        : type(IndexScan), relation(nullptr), projection(nullptr), select_conjunction(nullptr), table(table),
+          index(&index), index_key(key), estimated_rows(-1), estimated_cost(-1), considered() {
 }
 
 EvalPlan::EvalPlan(const EvalPlan *other)
-        : type(other->type), table(other->table) {
+        : type(other->type), table(other->table), index(other->index), estimated_rows(other->estimated_rows),
+          estimated_cost(other->estimated_cost), considered(other->considered) {
     if (other->relation != nullptr)
         relation = new EvalPlan(other->relation);
     else
@@ -50,52 +64,745 @@ EvalPlan::EvalPlan(const EvalPlan *other)
         select_conjunction = new ValueDict(*other->select_conjunction);
     else
         select_conjunction = nullptr;
+    if (other->index_key != nullptr)
+        index_key = new ValueDict(*other->index_key);
+    else
+        index_key = nullptr;
 }
 
 EvalPlan::~EvalPlan() {
     delete relation;
     delete projection;
     delete select_conjunction;
+    delete index_key;
 }
 
 
-EvalPlan *EvalPlan::optimize() {
-    return new EvalPlan(this);  // For now, we don't know how to do anything better
+// Cost of looking at a row in memory, in block reads
+static const double ROW_COST = 0.01;
+
+EvalPlan *EvalPlan::optimize(Indices *indices, Statistics *statistics) {
+    EvalPlan *ret = new EvalPlan(this);
+    EvalPlan *scan = ret;
+    while (scan->relation != nullptr)
+        scan = scan->relation;
+    TableStatistics stats = {false, 0, 0, {}, {}};
+    if (statistics != nullptr)
+        stats = statistics->get(scan->table.get_table_name());
+    if (indices != nullptr)
+        ret = ret->use_index(*indices, stats);
+    if (stats.analyzed)
+        ret->estimate(stats);
+    return ret;
 }
 
-ValueDicts *EvalPlan::evaluate() {
-    ValueDicts *ret = nullptr;
-    if (this->type != ProjectAll && this->type != Project)
-        throw DbRelationError("Invalid evaluation plan--not ending with a projection");
+// Rewrite a Select on a TableScan whose conjunction has a value for each key column of one of the table's
+// indices into an IndexScan for those values, under a Select of the rest of the conjunction (if there is any).
+// If the table has been analyzed, the cheapest of the scan and the IndexScans is picked (so a table of a block
+// or two is still scanned). Otherwise a unique index is picked over one that is not, then one with more key
+// columns over one with fewer. A value of the wrong type for its column is left to the scan (which finds
+// nothing). Returns this plan, or deletes it and returns the rewritten one.
+EvalPlan *EvalPlan::use_index(Indices &indices, const TableStatistics &stats) {
+    if (this->relation != nullptr)
+        this->relation = this->relation->use_index(indices, stats);
+    if (this->type != Select || this->relation->type != TableScan)
+        return this;
 
-    EvalPipeline pipeline = this->relation->pipeline();
-    DbRelation *temp_table = pipeline.first;
-    Handles *handles = pipeline.second;
-    if (this->type == ProjectAll)
-        ret = temp_table->project(handles);
-    else if (this->type == Project)
-        ret = temp_table->project(handles, this->projection);
-    delete handles;
+    DbRelation &table = this->relation->table;
+    Identifier table_name = table.get_table_name();
+    Identifier best;
+    ColumnNames best_columns;
+    bool best_unique = false;
+    EvalPlan *cheapest = nullptr;
+    bool covering = false;
+    std::ostringstream considered;
+    considered << std::fixed << std::setprecision(2);
+    if (stats.analyzed) {
+        estimate(stats);
+        considered << "TableScan (cost " << this->relation->estimated_cost << ")";
+    }
+    for (auto const& index_name: indices.get_index_names(table_name)) {
+        ColumnNames key_columns;
+        bool is_hash, is_unique;
+        indices.get_columns(table_name, index_name, key_columns, is_hash, is_unique);
+        if (is_hash)
+            continue;  // no hash index can look anything up yet
+        ColumnAttributes *attributes = table.get_column_attributes(key_columns);
+        bool covered = !key_columns.empty();
+        for (size_t i = 0; covered && i < key_columns.size(); i++) {
+            auto value = this->select_conjunction->find(key_columns[i]);
+            covered = value != this->select_conjunction->end() && value->second.data_type == (*attributes)[i].get_data_type();
+        }
+        delete attributes;
+        if (!covered)
+            continue;
+        covering = true;
+        if (stats.analyzed) {
+            EvalPlan *plan = index_scan(indices.get_index(table_name, index_name), key_columns);
+            plan->estimate(stats);
+            considered << ", IndexScan " << index_name << " (cost " << plan->estimated_cost << ")";
+            if (plan->estimated_cost < (cheapest == nullptr ? this->estimated_cost : cheapest->estimated_cost)) {
+                delete cheapest;
+                cheapest = plan;
+            } else {
+                delete plan;
+            }
+        } else if (best.empty() || (is_unique && !best_unique)
+                   || (is_unique == best_unique && key_columns.size() > best_columns.size())) {
+            best = index_name;
+            best_columns = key_columns;
+            best_unique = is_unique;
+        }
+    }
+    if (stats.analyzed && covering) {
+        EvalPlan *access = cheapest == nullptr ? this->relation : cheapest;
+        while (access->relation != nullptr)
+            access = access->relation;
+        access->considered = considered.str();
+        if (cheapest == nullptr)
+            return this;
+        delete this;
+        return cheapest;
+    }
+    if (best.empty())
+        return this;
+
+    EvalPlan *plan = index_scan(indices.get_index(table_name, best), best_columns);
+    delete this;
+    return plan;
+}
+
+// This Select (on a TableScan) as an IndexScan for the key columns' values, under a Select of the rest of the
+// conjunction (if there is any)
+EvalPlan *EvalPlan::index_scan(DbIndex &index, const ColumnNames &key_columns) const {
+    ValueDict *key = new ValueDict();
+    ValueDict *residual = new ValueDict();
+    for (auto const& column: *this->select_conjunction)
+        if (std::find(key_columns.begin(), key_columns.end(), column.first) != key_columns.end())
+            (*key)[column.first] = column.second;
+        else
+            (*residual)[column.first] = column.second;
+    EvalPlan *plan = new EvalPlan(index, key, this->relation->table);
+    if (residual->empty())
+        delete residual;
+    else
+        plan = new EvalPlan(residual, plan);
+    return plan;
+}
+
+// Fraction of a table's rows with the given values, taking the columns to be independent and their values to
+// be evenly spread
+static double selectivity(const TableStatistics &stats, const ValueDict &conjunction) {
+    double fraction = 1.0;
+    for (auto const& column: conjunction) {
+        auto distinct = stats.distinct.find(column.first);
+        if (distinct != stats.distinct.end() && distinct->second > 0)
+            fraction /= distinct->second;
+    }
+    return fraction;
+}
+
+// Estimate the rows out of each step and the cost of getting them, in block reads (an IndexScan reads a block
+// per level of the index, then one per row it finds; a TableScan reads every block, then looks at every row).
+void EvalPlan::estimate(const TableStatistics &stats) {
+    double rows = 0.0, cost = 0.0;
+    if (this->relation != nullptr) {
+        this->relation->estimate(stats);
+        rows = this->relation->estimated_rows;
+        cost = this->relation->estimated_cost;
+    }
+    switch (this->type) {
+        case TableScan:
+            this->estimated_rows = (double)stats.rows;
+            this->estimated_cost = (double)stats.blocks + stats.rows * ROW_COST;
+            break;
+        case IndexScan: {
+            auto height = stats.heights.find(this->index->get_name());
+            if (this->index->is_unique())
+                this->estimated_rows = std::min(1.0, (double)stats.rows);
+            else
+                this->estimated_rows = stats.rows * selectivity(stats, *this->index_key);
+            this->estimated_cost = (height == stats.heights.end() ? 1.0 : (double)height->second)
+                                   + this->estimated_rows * (1.0 + ROW_COST);
+            break;
+        }
+        case Select:
+            // (a Select on a TableScan is done by the scan, as it looks at each row)
+            this->estimated_rows = rows * selectivity(stats, *this->select_conjunction);
+            this->estimated_cost = cost + (this->relation->type == TableScan ? 0.0 : rows * ROW_COST);
+            break;
+        case ProjectAll:
+        case Project:
+            this->estimated_rows = rows;
+            this->estimated_cost = cost;
+            break;
+    }
+}
+
+std::string EvalPlan::explain() const {
+    std::ostringstream out;
+    explain(out, 0);
+    return out.str();
+}
+
+static void explain_values(std::ostream &out, const ValueDict &values) {
+    bool first = true;
+    for (auto const& column: values) {
+        out << (first ? " " : " AND ") << column.first << " = ";
+        switch (column.second.data_type) {
+            case ColumnAttribute::INT:
+                out << column.second.n;
+                break;
+            case ColumnAttribute::TEXT:
+                out << "\"" << column.second.s << "\"";
+                break;
+            case ColumnAttribute::BOOLEAN:
+                out << (column.second.n == 0 ? "false" : "true");
+                break;
+        }
+        first = false;
+    }
+}
+
+void EvalPlan::explain(std::ostream &out, uint depth) const {
+    out << std::string(2 * depth, ' ');
+    switch (this->type) {
+        case ProjectAll:
+            out << "ProjectAll";
+            break;
+        case Project:
+            out << "Project";
+            for (size_t i = 0; i < this->projection->size(); i++)
+                out << (i == 0 ? " " : ", ") << (*this->projection)[i];
+            break;
+        case Select:
+            out << "Select";
+            explain_values(out, *this->select_conjunction);
+            break;
+        case TableScan:
+            out << "TableScan " << this->table.get_table_name();
+            break;
+        case IndexScan:
+            out << "IndexScan " << this->table.get_table_name() << " using " << this->index->get_name();
+            explain_values(out, *this->index_key);
+            break;
+    }
+    if (this->estimated_cost >= 0.0)
+        out << std::fixed << std::setprecision(2) << "  (rows " << this->estimated_rows << ", cost "
+            << this->estimated_cost << ")";
+    out << std::endl;
+    if (!this->considered.empty())
+        out << std::string(2 * depth + 2, ' ') << "considered: " << this->considered << std::endl;
+    if (this->relation != nullptr)
+        this->relation->explain(out, depth + 1);
+}
+
+// Pull all the rows of the plan.
+Rows *EvalPlan::evaluate(Arena *arena) {
+    RowIterator *iterator = this->rows(arena);
+    Rows *ret = new Rows();
+    try {
+        iterator->open();
+        for (Row *row = iterator->next(); row != nullptr; row = iterator->next())
+            ret->push_back(row);
+        iterator->close();
+    } catch (...) {
+        if (arena == nullptr)
+            for (auto const& row: *ret)
+                delete row;
+        delete ret;
+        delete iterator;
+        throw;
+    }
+    delete iterator;
     return ret;
 }
 
+// Pull all the handles of the plan (e.g., for a DELETE, which must not change the table while it is scanned).
 EvalPipeline EvalPlan::pipeline() {
+    HandleIterator *iterator = this->handles();
+    Handles *ret = new Handles();
+    try {
+        Handles batch;
+        iterator->open();
+        while (iterator->next(batch))
+            ret->insert(ret->end(), batch.begin(), batch.end());
+        iterator->close();
+    } catch (...) {
+        delete ret;
+        delete iterator;
+        throw;
+    }
+    EvalPipeline pipeline(&iterator->get_relation(), ret);
+    delete iterator;
+    return pipeline;
+}
+
+bool EvalPlan::vectorized = false;
+
+RowIterator *EvalPlan::rows(Arena *arena) {
+    if (this->type != ProjectAll && this->type != Project)
+        throw DbRelationError("Invalid evaluation plan--not ending with a projection");
+    EvalPlan *scan = this->relation;
+    while (scan->relation != nullptr)
+        scan = scan->relation;
+    if (!vectorized || scan->type != TableScan)  // an index lookup finds a few rows, not chunks of them
+        return new ProjectIterator(this->relation->handles(), this->projection, arena);
+
+    // the chunks carry the projected columns, then any others the Selects above the scan look at
+    ColumnNames projection = this->type == Project ? *this->projection : scan->table.get_column_names();
+    ColumnNames columns = projection;
+    for (EvalPlan *plan = this->relation; plan->type == Select && plan->relation->type != TableScan; plan = plan->relation)
+        for (auto const& column: *plan->select_conjunction)
+            if (std::find(columns.begin(), columns.end(), column.first) == columns.end())
+                columns.push_back(column.first);
+    ColumnAttributes *attributes = scan->table.get_column_attributes(columns);
+    std::vector<ColumnAttribute::DataType> types;
+    for (auto& attribute: *attributes)
+        types.push_back(attribute.get_data_type());
+    delete attributes;
+    DataChunk *chunk = new DataChunk(std::make_shared<const ColumnNames>(columns), types);
+    return new ChunkProjectIterator(this->relation->chunks(columns), chunk, projection, arena);
+}
+
+HandleIterator *EvalPlan::handles() {
     // base cases
     if (this->type == TableScan)
-        return EvalPipeline(&this->table, this->table.select());
+        return new TableScanIterator(this->table, nullptr);
+    if (this->type == IndexScan)
+        return new IndexScanIterator(this->table, *this->index, this->index_key);
     if (this->type == Select && this->relation->type == TableScan)
-        return EvalPipeline(&this->relation->table, this->relation->table.select(this->select_conjunction));
+        return new TableScanIterator(this->relation->table, this->select_conjunction);
 
     // recursive case
-    if (this->type == Select) {
-        EvalPipeline pipeline = this->relation->pipeline();
-        DbRelation *temp_table = pipeline.first;
-        Handles *handles = pipeline.second;
-        EvalPipeline ret(temp_table, temp_table->select(handles, this->select_conjunction));
-        delete handles;
-        return ret;
-    }
+    if (this->type == Select)
+        return new SelectIterator(this->relation->handles(), this->select_conjunction);
+
+    throw DbRelationError("Not implemented: pipeline other than Select or TableScan");
+}
+
+ChunkIterator *EvalPlan::chunks(const ColumnNames &columns) {
+    // base cases
+    if (this->type == TableScan)
+        return new ChunkScanIterator(this->table, nullptr, columns);
+    if (this->type == Select && this->relation->type == TableScan)
+        return new ChunkScanIterator(this->relation->table, this->select_conjunction, columns);
+
+    // recursive case
+    if (this->type == Select)
+        return new ChunkSelectIterator(this->relation->chunks(columns), this->select_conjunction);
 
     throw DbRelationError("Not implemented: pipeline other than Select or TableScan");
 }
 
+
+void TableScanIterator::open() {
+    close();
+    this->cursor = this->relation.cursor(this->where, DbFile::SEQUENTIAL);
+}
+
+bool TableScanIterator::next(Handles &handles) {
+    if (this->cursor == nullptr)
+        throw DbRelationError("iterator not open");
+    return this->cursor->next(handles);
+}
+
+void TableScanIterator::close() {
+    delete this->cursor;
+    this->cursor = nullptr;
+}
+
+
+void IndexScanIterator::open() {
+    close();
+    this->index.open();  // (an index from the cache after a restart is still closed)
+    this->found = this->index.lookup(this->key);
+}
+
+bool IndexScanIterator::next(Handles &handles) {
+    if (this->found == nullptr)
+        throw DbRelationError("iterator not open");
+    handles.clear();
+    if (this->found->empty())
+        return false;
+    handles.swap(*this->found);
+    return true;
+}
+
+void IndexScanIterator::close() {
+    delete this->found;
+    this->found = nullptr;
+}
+
+
+void SelectIterator::open() {
+    this->input->open();
+}
+
+// Filter the input's batches until one has something left.
+bool SelectIterator::next(Handles &handles) {
+    Handles batch;
+    while (this->input->next(batch)) {
+        Handles *selected = this->relation.select(&batch, this->where);
+        handles.swap(*selected);
+        delete selected;
+        if (!handles.empty())
+            return true;
+    }
+    handles.clear();
+    return false;
+}
+
+void SelectIterator::close() {
+    this->input->close();
+}
+
+
+ProjectIterator::ProjectIterator(HandleIterator *input, const ColumnNames *projection, Arena *arena)
+        : input(input), columns(), arena(arena), rows(nullptr), at(0) {
+    if (projection != nullptr)
+        this->columns = std::make_shared<const ColumnNames>(*projection);
+}
+
+ProjectIterator::~ProjectIterator() {
+    discard();
+    delete input;
+}
+
+void ProjectIterator::open() {
+    discard();
+    this->input->open();
+}
+
+// The next row of the current batch, or the first of the next one.
+Row *ProjectIterator::next() {
+    while (this->rows == nullptr || this->at == this->rows->size()) {
+        discard();
+        Handles handles;
+        if (!this->input->next(handles))
+            return nullptr;
+        if (this->columns)
+            this->rows = this->input->get_relation().project(&handles, this->columns, this->arena);
+        else
+            this->rows = this->input->get_relation().project(&handles, this->arena);
+        this->at = 0;
+    }
+    return (*this->rows)[this->at++];
+}
+
+void ProjectIterator::close() {
+    discard();
+    this->input->close();
+}
+
+// Let go of the current batch, deleting the rows not handed out yet (unless the arena has them).
+void ProjectIterator::discard() {
+    if (this->rows != nullptr && this->arena == nullptr)
+        for (size_t i = this->at; i < this->rows->size(); i++)
+            delete (*this->rows)[i];
+    delete this->rows;
+    this->rows = nullptr;
+    this->at = 0;
+}
+
+
+void ChunkScanIterator::open() {
+    close();
+    this->cursor = this->table.cursor(this->where, this->columns, DbFile::SEQUENTIAL);
+}
+
+bool ChunkScanIterator::next(DataChunk &chunk) {
+    if (this->cursor == nullptr)
+        throw DbRelationError("iterator not open");
+    return this->cursor->next(chunk);
+}
+
+void ChunkScanIterator::close() {
+    delete this->cursor;
+    this->cursor = nullptr;
+}
+
+
+void ChunkSelectIterator::open() {
+    this->input->open();
+}
+
+// Narrow the input's chunks by each of the where values, until one has something left.
+bool ChunkSelectIterator::next(DataChunk &chunk) {
+    while (this->input->next(chunk)) {
+        for (auto const& column: *this->where) {
+            int j = chunk.column(column.first);
+            if (j < 0)
+                throw DbRelationError("unknown column " + column.first);
+            chunk.select((uint)j, FilterKernels::EQUAL, column.second);
+        }
+        if (chunk.selected() > 0)
+            return true;
+    }
+    return false;
+}
+
+void ChunkSelectIterator::close() {
+    this->input->close();
+}
+
+
+ChunkProjectIterator::ChunkProjectIterator(ChunkIterator *input, DataChunk *chunk, const ColumnNames &projection,
+                                           Arena *arena)
+        : input(input), chunk(chunk), columns(std::make_shared<const ColumnNames>(projection)), indexes(),
+          arena(arena), at(0), started(false) {
+    for (auto const& column_name: projection)
+        this->indexes.push_back((uint)chunk->column(column_name));
+}
+
+ChunkProjectIterator::~ChunkProjectIterator() {
+    delete input;
+    delete chunk;
+}
+
+void ChunkProjectIterator::open() {
+    this->started = false;
+    this->input->open();
+}
+
+// The next selected row of the current chunk, or the first of the next one (its TEXT values copied out of
+// the blocks, so the row outlives the chunk).
+Row *ChunkProjectIterator::next() {
+    while (!this->started || this->at == this->chunk->selected()) {
+        if (!this->input->next(*this->chunk))
+            return nullptr;
+        this->started = true;
+        this->at = 0;
+    }
+    return this->chunk->row(this->chunk->selection()[this->at++], this->indexes, this->columns, this->arena);
+}
+
+// Lets go of the chunk's blocks, too.
+void ChunkProjectIterator::close() {
+    this->chunk->reset();
+    this->started = false;
+    this->input->close();
+}
+
+
+// Make a table (x INT, y TEXT) known to the schema tables, of n rows with x from 0 to n-1 and y "y<x % 10>",
+// with a unique BTREE index on x (by_x) and a HASH index on y (by_y)
+static DbRelation &test_plan_table(Tables &tables, Indices &indices, Identifier table_name, int n) {
+    ValueDict row;
+    row["table_name"] = Value(table_name);
+    tables.insert(&row);
+    DbRelation &columns = Tables::get_table(Columns::TABLE_NAME);
+    row["column_name"] = Value("x");
+    row["data_type"] = Value("INT");
+    columns.insert(&row);
+    row["column_name"] = Value("y");
+    row["data_type"] = Value("TEXT");
+    columns.insert(&row);
+
+    DbRelation &table = Tables::get_table(table_name);
+    table.create();
+    for (int i = 0; i < n; i++) {
+        ValueDict values;
+        values["x"] = Value(i);
+        values["y"] = Value("y" + std::to_string(i % 10));
+        table.insert(&values);
+    }
+
+    ValueDict index_row;
+    index_row["table_name"] = Value(table_name);
+    index_row["seq_in_index"] = Value(1);
+    index_row["index_name"] = Value("by_x");
+    index_row["index_type"] = Value("BTREE");
+    index_row["is_unique"] = Value(true);
+    index_row["column_name"] = Value("x");
+    indices.insert(&index_row);
+    index_row["index_name"] = Value("by_y");
+    index_row["index_type"] = Value("HASH");
+    index_row["is_unique"] = Value(false);
+    index_row["column_name"] = Value("y");
+    indices.insert(&index_row);
+    for (auto const& index_name: indices.get_index_names(table_name))
+        indices.get_index(table_name, index_name).create();
+    return table;
+}
+
+// Drop a table made by test_plan_table, and take it out of the schema tables
+static void test_plan_drop(Tables &tables, Indices &indices, Identifier table_name) {
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    for (auto const& index_name: indices.get_index_names(table_name))
+        indices.get_index(table_name, index_name).drop();
+    Handles *handles = indices.select(&where);
+    for (auto const& handle: *handles)
+        indices.del(handle);
+    delete handles;
+    Tables::get_table(table_name).drop();
+    DbRelation &columns = Tables::get_table(Columns::TABLE_NAME);
+    handles = columns.select(&where);
+    for (auto const& handle: *handles)
+        columns.del(handle);
+    delete handles;
+    handles = tables.select(&where);
+    for (auto const& handle: *handles)
+        tables.del(handle);
+    delete handles;
+}
+
+// SELECT x FROM table WHERE <where>, optimized with the indices and statistics (if given): the x values, in
+// order, and the plan
+static std::vector<int> test_plan_select(DbRelation &table, const ValueDict &where, Indices *indices, std::string &plan_text,
+                                         Statistics *statistics=nullptr) {
+    ColumnNames *projection = new ColumnNames({"x"});
+    EvalPlan *plan = new EvalPlan(projection, new EvalPlan(new ValueDict(where), new EvalPlan(table)));
+    EvalPlan *optimized = plan->optimize(indices, statistics);
+    plan_text = optimized->explain();
+    Rows *rows = optimized->evaluate();
+    std::vector<int> xs;
+    for (auto const& row: *rows) {
+        xs.push_back((*row)["x"].n);
+        delete row;
+    }
+    std::sort(xs.begin(), xs.end());
+    delete rows;
+    delete optimized;
+    delete plan;
+    return xs;
+}
+
+// test function -- returns true if all tests pass
+bool test_eval_plan() {
+    Tables tables;
+    Indices indices;
+    const Identifier table_name = "_test_plan";
+    DbRelation &table = test_plan_table(tables, indices, table_name, 100);
+    bool ok = true;
+    std::string plan;
+
+    // a Select covering the BTREE index's key becomes an IndexScan
+    ValueDict where;
+    where["x"] = Value(42);
+    ok = ok && test_plan_select(table, where, &indices, plan) == std::vector<int>({42})
+         && plan.find("IndexScan " + table_name + " using by_x x = 42") != std::string::npos;
+    ok = ok && test_plan_select(table, where, nullptr, plan) == std::vector<int>({42})
+         && plan.find("IndexScan") == std::string::npos;
+
+    // ... under a Select of the rest of the conjunction
+    where["y"] = Value("y2");
+    ok = ok && test_plan_select(table, where, &indices, plan) == std::vector<int>({42})
+         && plan.find("Select y = \"y2\"") != std::string::npos && plan.find("IndexScan") != std::string::npos;
+    where["y"] = Value("y3");
+    ok = ok && test_plan_select(table, where, &indices, plan).empty();
+
+    // a value of the wrong type for the key column is left to the scan, which finds nothing
+    ValueDict wrong;
+    wrong["x"] = Value("42");
+    ok = ok && test_plan_select(table, wrong, &indices, plan).empty() && plan.find("IndexScan") == std::string::npos;
+
+    // the HASH index cannot look anything up, so its Select stays a scan
+    ValueDict on_y;
+    on_y["y"] = Value("y3");
+    std::vector<int> threes = test_plan_select(table, on_y, &indices, plan);
+    ok = ok && threes.size() == 10 && threes[0] == 3 && threes[9] == 93 && plan.find("IndexScan") == std::string::npos;
+
+    // the same SELECTs passing DataChunks (a Select left above an IndexScan still goes a row at a time)
+    EvalPlan::vectorized = true;
+    ValueDict both;
+    both["x"] = Value(42);
+    both["y"] = Value("y2");
+    ok = ok && test_plan_select(table, both, nullptr, plan) == std::vector<int>({42})
+         && test_plan_select(table, both, &indices, plan) == std::vector<int>({42})
+         && plan.find("Select y = \"y2\"") != std::string::npos && plan.find("IndexScan") != std::string::npos
+         && test_plan_select(table, on_y, &indices, plan) == threes;
+
+    // a Select above another one narrows the scan's chunks, which carry its column as well as the projected
+    // ones (SQL puts a single Select on the scan, but a pipeline takes any chain of them)
+    ValueDict on_x;
+    on_x["x"] = Value(33);
+    EvalPlan *stacked = new EvalPlan(new ColumnNames({"x"}),
+                                     new EvalPlan(new ValueDict(on_y), new EvalPlan(new ValueDict(on_x), new EvalPlan(table))));
+    Rows *rows = stacked->evaluate();
+    ok = ok && rows->size() == 1 && (*rows)[0]->at("x").n == 33 && !(*rows)[0]->has("y");
+    for (auto const& row: *rows)
+        delete row;
+    delete rows;
+    delete stacked;
+    stacked = new EvalPlan(EvalPlan::ProjectAll,
+                           new EvalPlan(new ValueDict(on_y), new EvalPlan(new ValueDict(on_x), new EvalPlan(table))));
+    rows = stacked->evaluate();
+    ok = ok && rows->size() == 1 && (*rows)[0]->at("x").n == 33 && (*rows)[0]->at("y").s == "y3";
+    for (auto const& row: *rows)
+        delete row;
+    delete rows;
+    delete stacked;
+    on_x["x"] = Value(34);
+    stacked = new EvalPlan(new ColumnNames({"x"}),
+                           new EvalPlan(new ValueDict(on_y), new EvalPlan(new ValueDict(on_x), new EvalPlan(table))));
+    rows = stacked->evaluate();
+    ok = ok && rows->empty();
+    delete rows;
+    delete stacked;
+    EvalPlan::vectorized = false;
+
+    // a DELETE's handles come through the IndexScan
+    ValueDict doomed;
+    doomed["x"] = Value(7);
+    EvalPlan *del = new EvalPlan(new ValueDict(doomed), new EvalPlan(table));
+    EvalPlan *optimized = del->optimize(&indices);
+    ok = ok && optimized->explain().find("IndexScan") != std::string::npos;
+    EvalPipeline pipeline = optimized->pipeline();
+    ok = ok && pipeline.first == &table && pipeline.second->size() == 1;
+    for (auto const& handle: *pipeline.second)
+        table.del(handle);  // (a BTREE index cannot delete entries yet, so the scan below checks)
+    delete pipeline.second;
+    delete optimized;
+    delete del;
+    ok = ok && test_plan_select(table, doomed, nullptr, plan).empty();
+    Handles *rest = table.select();
+    ok = ok && rest->size() == 99;
+    delete rest;
+    test_plan_drop(tables, indices, table_name);
+    if (!ok)
+        return false;
+
+    // ANALYZE counts rows, blocks, and distinct values, and gets the height of the BTREE index (not the HASH one)
+    Statistics statistics;
+    const Identifier big_name = "_test_plan_big", small_name = "_test_plan_small";
+    DbRelation &big = test_plan_table(tables, indices, big_name, 2000);
+    DbRelation &small = test_plan_table(tables, indices, small_name, 10);
+    TableStatistics stats = statistics.analyze(big, indices);
+    TableStatistics kept = statistics.get(big_name);
+    ok = stats.analyzed && stats.rows == 2000 && stats.blocks == big.get_block_count() && stats.blocks > 1
+         && stats.distinct["x"] == 2000 && stats.distinct["y"] == 10 && stats.heights.size() == 1
+         && stats.heights["by_x"] >= 1 && kept.analyzed && kept.rows == stats.rows && kept.blocks == stats.blocks
+         && kept.distinct == stats.distinct && kept.heights == stats.heights;
+    stats = statistics.analyze(small, indices);
+    ok = ok && stats.rows == 10 && stats.blocks == 1 && stats.heights["by_x"] == 1;
+
+    // a many-block table is looked up in the index; a 1-block one is cheaper to scan
+    ValueDict one;
+    one["x"] = Value(3);
+    ok = ok && test_plan_select(big, one, &indices, plan, &statistics) == std::vector<int>({3})
+         && plan.find("IndexScan " + big_name + " using by_x x = 3  (rows 1.00, cost ") != std::string::npos
+         && plan.find("considered: TableScan (cost ") != std::string::npos;
+    ok = ok && test_plan_select(small, one, &indices, plan, &statistics) == std::vector<int>({3})
+         && plan == "Project x  (rows 1.00, cost 1.10)\n"
+                    "  Select x = 3  (rows 1.00, cost 1.10)\n"
+                    "    TableScan " + small_name + "  (rows 10.00, cost 1.10)\n"
+                    "      considered: TableScan (cost 1.10), IndexScan by_x (cost 2.01)\n";
+
+    // the HASH index is never costed; a table without statistics gets the index by rule, without estimates
+    ValueDict on_y_big;
+    on_y_big["y"] = Value("y3");
+    ok = ok && test_plan_select(big, on_y_big, &indices, plan, &statistics).size() == 200
+         && plan.find("IndexScan") == std::string::npos && plan.find("considered") == std::string::npos;
+    statistics.forget(small_name);
+    ok = ok && !statistics.get(small_name).analyzed
+         && test_plan_select(small, one, &indices, plan, &statistics) == std::vector<int>({3})
+         && plan == "Project x\n"
+                    "  IndexScan " + small_name + " using by_x x = 3\n";
+
+    statistics.forget(big_name);
+    test_plan_drop(tables, indices, big_name);
+    test_plan_drop(tables, indices, small_name);
+    return ok;
+}
@@ -1,39 +1,218 @@
 #pragma once
 
 #include "storage_engine.h"
+#include "data_chunk.h"
 
 
+class Indices;
+class Statistics;
+struct TableStatistics;
+
 typedef std::pair<DbRelation*,Handles*> EvalPipeline;
 
+// A running stage of a plan that yields handles: open(), then next() until it returns false, then close().
+// Each next() gets one batch (e.g., a morsel's worth of a table scan), so nothing holds the whole selection.
+class HandleIterator {
+public:
+    HandleIterator(DbRelation &relation) : relation(relation) {}
+    virtual ~HandleIterator() {}
+    virtual void open() = 0;
+    virtual bool next(Handles &handles) = 0;  // returns the next (non-empty) batch; false when there are no more
+    virtual void close() = 0;
+    DbRelation &get_relation() {return relation;}
+
+protected:
+    DbRelation &relation;
+};
+
+// TableScan (with a Select right above it pushed into the scan)
+class TableScanIterator : public HandleIterator {
+public:
+    TableScanIterator(DbRelation &table, const ValueDict *where) : HandleIterator(table), where(where), cursor(nullptr) {}
+    virtual ~TableScanIterator() {close();}
+    virtual void open();
+    virtual bool next(Handles &handles);
+    virtual void close();
+
+protected:
+    const ValueDict *where;
+    DbCursor *cursor;
+};
+
+// IndexScan: the handles the index has for the key, all in one batch
+class IndexScanIterator : public HandleIterator {
+public:
+    IndexScanIterator(DbRelation &table, DbIndex &index, ValueDict *key)
+            : HandleIterator(table), index(index), key(key), found(nullptr) {}
+    virtual ~IndexScanIterator() {close();}
+    virtual void open();
+    virtual bool next(Handles &handles);
+    virtual void close();
+
+protected:
+    DbIndex &index;
+    ValueDict *key;
+    Handles *found;  // until they are handed out
+};
+
+// Select on the output of another stage
+class SelectIterator : public HandleIterator {
+public:
+    SelectIterator(HandleIterator *input, const ValueDict *where)
+            : HandleIterator(input->get_relation()), input(input), where(where) {}
+    virtual ~SelectIterator() {delete input;}
+    virtual void open();
+    virtual bool next(Handles &handles);
+    virtual void close();
+
+protected:
+    HandleIterator *input;
+    const ValueDict *where;
+};
+
+// The running top of a plan, ProjectAll or Project: open(), then next() until it returns nullptr, then close().
+// Rows are built in the arena if one is given (else the caller deletes them).
+class RowIterator {
+public:
+    virtual ~RowIterator() {}
+    virtual void open() = 0;
+    virtual Row *next() = 0;
+    virtual void close() = 0;
+};
+
+// Project (or ProjectAll) on a stage yielding handles, a batch of them at a time
+class ProjectIterator : public RowIterator {
+public:
+    ProjectIterator(HandleIterator *input, const ColumnNames *projection, Arena *arena);  // projection nullptr for all
+    virtual ~ProjectIterator();
+    virtual void open();
+    virtual Row *next();
+    virtual void close();
+
+protected:
+    HandleIterator *input;
+    RowSchema columns;  // shared by all the rows (empty for all columns)
+    Arena *arena;
+    Rows *rows;         // the current batch
+    size_t at;          // next of them to hand out
+    virtual void discard();
+};
+
+// A running stage of a vectorized plan: open(), then next() until it returns false, then close().
+// Each next() fills a DataChunk with the columns the stages above need.
+class ChunkIterator {
+public:
+    virtual ~ChunkIterator() {}
+    virtual void open() = 0;
+    virtual bool next(DataChunk &chunk) = 0;  // fills the chunk (with some rows selected); false when there are no more
+    virtual void close() = 0;
+};
+
+// TableScan (with a Select right above it pushed into the scan), decoding the blocks into chunks
+class ChunkScanIterator : public ChunkIterator {
+public:
+    ChunkScanIterator(DbRelation &table, const ValueDict *where, const ColumnNames &columns)
+            : table(table), where(where), columns(columns), cursor(nullptr) {}
+    virtual ~ChunkScanIterator() {close();}
+    virtual void open();
+    virtual bool next(DataChunk &chunk);
+    virtual void close();
+
+protected:
+    DbRelation &table;
+    const ValueDict *where;
+    ColumnNames columns;
+    DbCursor *cursor;
+};
+
+// Select on the chunks of another stage, narrowing their selection vectors
+class ChunkSelectIterator : public ChunkIterator {
+public:
+    ChunkSelectIterator(ChunkIterator *input, const ValueDict *where) : input(input), where(where) {}
+    virtual ~ChunkSelectIterator() {delete input;}
+    virtual void open();
+    virtual bool next(DataChunk &chunk);
+    virtual void close();
+
+protected:
+    ChunkIterator *input;
+    const ValueDict *where;
+};
+
+// Project (or ProjectAll) on a stage yielding chunks: the selected rows of each chunk, in turn
+class ChunkProjectIterator : public RowIterator {
+public:
+    ChunkProjectIterator(ChunkIterator *input, DataChunk *chunk, const ColumnNames &projection, Arena *arena);
+    virtual ~ChunkProjectIterator();
+    virtual void open();
+    virtual Row *next();
+    virtual void close();
+
+protected:
+    ChunkIterator *input;
+    DataChunk *chunk;            // the current chunk (of at least the projected columns)
+    RowSchema columns;           // the projection, shared by all the rows
+    std::vector<uint> indexes;   // ... and where each column is in the chunk
+    Arena *arena;
+    uint at;                     // next selected row of the chunk to hand out
+    bool started;
+};
+
 class EvalPlan {
 public:
     enum PlanType {
         ProjectAll,
         Project,
         Select,
-        TableScan
+        TableScan,
+        IndexScan
     };
 
     EvalPlan(PlanType type, EvalPlan *relation);  // use for ProjectAll, e.g., EvalPlan(EvalPlan::ProjectAll, table);
     EvalPlan(ColumnNames *projection, EvalPlan *relation); // use for Project
     EvalPlan(ValueDict* conjunction, EvalPlan *relation);  // use for Select
     EvalPlan(DbRelation &table);  // use for TableScan
+    EvalPlan(DbIndex &index, ValueDict *key, DbRelation &table);  // use for IndexScan (of table, for key)
     EvalPlan(const EvalPlan *other);  // use for copying
     virtual ~EvalPlan();
 
-    // Attempt to get the best equivalent evaluation plan
-    EvalPlan *optimize();
+    // Attempt to get the best equivalent evaluation plan (looking up rows in the tables' indices, if given,
+    // where the tables' statistics, if given and analyzed, say that costs less than scanning)
+    EvalPlan *optimize(Indices *indices=nullptr, Statistics *statistics=nullptr);
+
+    // The plan a step per line, with the rows and cost optimize estimated for each (if it could)
+    std::string explain() const;
 
-    // Evaluate the plan: evaluate gets values, pipeline gets handles
-    ValueDicts *evaluate();
+    // Evaluate the plan: evaluate gets values (built in the arena, if given), pipeline gets handles
+    Rows *evaluate(Arena *arena=nullptr);
     EvalPipeline pipeline();
 
+    // Start the plan running, to be pulled from: rows for a plan ending with a projection, handles otherwise
+    // (rows passes DataChunks from stage to stage if vectorized is set)
+    RowIterator *rows(Arena *arena=nullptr);
+    HandleIterator *handles();
+    ChunkIterator *chunks(const ColumnNames &columns);
+
+    // Whether plans are evaluated a DataChunk at a time (instead of a row at a time)
+    static bool vectorized;
+
 protected:
 
     PlanType type;
     EvalPlan *relation;  // for everything except TableScan
     ColumnNames *projection;  // for Project
     ValueDict *select_conjunction;  // for Select
-    DbRelation &table;  // for TableScan
+    DbRelation &table;  // for TableScan and IndexScan
+    DbIndex *index;  // for IndexScan
+    ValueDict *index_key;  // for IndexScan
+    double estimated_rows;  // by optimize (negative if not estimated)
+    double estimated_cost;  // ... in block reads
+    std::string considered;  // access paths optimize weighed, for the one it chose
+
+    EvalPlan *use_index(Indices &indices, const TableStatistics &stats);
+    EvalPlan *index_scan(DbIndex &index, const ColumnNames &key_columns) const;
+    void estimate(const TableStatistics &stats);
+    void explain(std::ostream &out, uint depth) const;
 };
 
+bool test_eval_plan();
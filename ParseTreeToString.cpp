@@ -297,6 +297,13 @@ string ParseTreeToString::show(const ShowStatement *stmt) {
     return ret;
 }
 
+string ParseTreeToString::import(const ImportStatement *stmt) {
+    string ret("IMPORT FROM ");
+    ret += stmt->type == ImportStatement::kImportTbl ? "TBL" : "CSV";
+    ret += string(" FILE '") + stmt->filePath + "' INTO " + stmt->tableName;
+    return ret;
+}
+
 string ParseTreeToString::del(const DeleteStatement *stmt) {
     string ret("DELETE FROM ");
     ret += stmt->tableName;
@@ -322,8 +329,10 @@ string ParseTreeToString::statement(const SQLStatement *stmt) {
         case kStmtShow:
             return show((const ShowStatement *) stmt);
 
-        case kStmtError:
         case kStmtImport:
+            return import((const ImportStatement *) stmt);
+
+        case kStmtError:
         case kStmtUpdate:
         case kStmtPrepare:
         case kStmtExecute:
@@ -40,5 +40,6 @@ private:
     static std::string create(const hsql::CreateStatement *stmt);
     static std::string drop(const hsql::DropStatement *stmt);
     static std::string show(const hsql::ShowStatement *stmt);
+    static std::string import(const hsql::ImportStatement *stmt);
 };
 
@@ -10,6 +10,16 @@ The code has been implemented to work but the statments remain to allow the next
 to find the implemented code easier by searching for 'Fixme'.
 */
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "SQLExec.h"
 #include "EvalPlan.h"
 #include <iostream>
@@ -19,6 +29,8 @@ using namespace hsql;
 
 Tables* SQLExec::tables = nullptr;
 Indices* SQLExec::indices = nullptr;
+Statistics* SQLExec::statistics = nullptr;
+Identifier SQLExec::storage_engine = Tables::HEAP;
 
 /**
 Allow results of query to print
@@ -65,10 +77,12 @@ QueryResult::~QueryResult() {
     if (column_attributes != nullptr)
         delete column_attributes;
     if (rows != nullptr) {
-        for (auto row: *rows)
-            delete row;
+        if (arena == nullptr)
+            for (auto row: *rows)
+                delete row;
         delete rows;
     }
+    delete arena;  // all the rows at once
 }
 
 /**
@@ -80,6 +94,8 @@ QueryResult *SQLExec::execute(const SQLStatement *statement) throw(SQLExecError)
         SQLExec::tables = new Tables();
     if (SQLExec::indices == nullptr)
         SQLExec::indices = new Indices();
+    if (SQLExec::statistics == nullptr)
+        SQLExec::statistics = new Statistics();
 
 
     try {
@@ -97,6 +113,8 @@ QueryResult *SQLExec::execute(const SQLStatement *statement) throw(SQLExecError)
                 return del((const DeleteStatement *) statement);
             case kStmtSelect:
                 return select((const SelectStatement *) statement);                
+            case kStmtImport:
+                return import((const ImportStatement *) statement);
             default:
                 return new QueryResult("not implemented");
         }
@@ -115,7 +133,8 @@ QueryResult *SQLExec::insert(const InsertStatement *statement) {
     SQLExec::tables->get_columns(table_name, column_names, column_attributes);     // get column info
 
     ValueDict row;                  // construct row to do table insert
-	Handles i_handles;              // handles to store the row
+    ValueDicts rows;                // rows of the statement, inserted as one batch
+    Handles* i_handles;             // handles to store the rows
     int indices_n = 0;              // counter for index
     bool eligible = true;           // flag to indicate whether it is eligible to execute INSERT
 
@@ -146,7 +165,8 @@ QueryResult *SQLExec::insert(const InsertStatement *statement) {
                     throw SQLExecError("Unrecognized column type");
 		    }
         }
-        i_handles.push_back(table.insert(&row));                // insert row to table        
+        rows.push_back(&row);
+        i_handles = table.insert_many(rows);                    // insert rows to table
     }
     else    // not eligible to execute INSERT
         throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
@@ -154,9 +174,10 @@ QueryResult *SQLExec::insert(const InsertStatement *statement) {
 	for (auto const& index_name: SQLExec::indices->get_index_names(table_name)) {
 		DbIndex& index = SQLExec::indices->get_index(table_name, index_name); // get the DbIndex using table name/index name
         indices_n++;                // count for number of index
-		for (auto const &handle: i_handles)
-			index.insert(handle);   // insert record into index
+		index.insert(i_handles);    // insert records into index, all together
 	}
+    u_long n = i_handles->size();
+    delete i_handles;
 
     string index_message;
 
@@ -165,19 +186,25 @@ QueryResult *SQLExec::insert(const InsertStatement *statement) {
     else                            // when indices_n is equal to 0, no need to show index info
         index_message = "";
 
-    return new QueryResult("successfully inserted " + to_string(i_handles.size()) + 
+    return new QueryResult("successfully inserted " + to_string(n) + 
                             " row into " + table_name + index_message);  // FIXME MILESTONE5
 }
 
+EvalPlan *SQLExec::delete_plan(const DeleteStatement *statement) {
+    DbRelation& table = SQLExec::tables->get_table(statement->tableName);   // get the table from DELETE command
+    EvalPlan *plan = new EvalPlan(table);                                   // create a new TableScan plan
+    if (statement->expr != nullptr)                                         // if DELETE FROM ... WHERE
+        plan = new EvalPlan(get_where_conjunction(statement->expr), plan);  // create a new plan for SELECT
+    return plan;
+}
+
 QueryResult *SQLExec::del(const DeleteStatement *statement) {
     try {
         Identifier table_name = statement->tableName;                           // get the table name from DELETE command
         DbRelation& table = SQLExec::tables->get_table(table_name);             // get the corresponding table
-        EvalPlan *plan = new EvalPlan(table);                                   // create a new TableScan plan 
-        if (statement->expr != nullptr)                                         // if SELECT ... FROM ... WHERE
-            plan = new EvalPlan(get_where_conjunction(statement->expr), plan);  // create a new plan for SELECT
+        EvalPlan *plan = delete_plan(statement);                                // TableScan, under a Select for WHERE
 
-        EvalPlan *optimized = plan->optimize();                                 // optimize the plan
+        EvalPlan *optimized = plan->optimize(SQLExec::indices, SQLExec::statistics);    // optimize the plan (using indices, if cheaper)
         EvalPipeline pipeline = optimized->pipeline();                          // pipeline gets handles
 
         auto index_names = SQLExec::indices->get_index_names(table_name);       // get the corresponding index names
@@ -245,40 +272,104 @@ ValueDict *SQLExec::get_where_conjunction(const Expr *whereClause) {
     return rows;
 }
 
+EvalPlan *SQLExec::select_plan(const SelectStatement *statement, ColumnNames *column_names) {
+    DbRelation& table = SQLExec::tables->get_table(statement->fromTable->name);     // get the table from SELECT command
+    EvalPlan *plan = new EvalPlan(table);                                           // create a new TableScan plan
+
+    if (statement->whereClause != nullptr)                                          // if whereClause is not nullptr
+        plan = new EvalPlan(get_where_conjunction(statement->whereClause), plan);   // create a new plan for SELECT
+
+    if (statement->selectList->at(0)->type == kExprStar) {                          // do "SELECT * from ...""
+        *column_names = table.get_column_names();                                   // get the column names of the table
+        plan = new EvalPlan(EvalPlan::ProjectAll, plan);                            // create a new plan for ProjectAll
+    }
+    else {
+        for (auto const column : *statement->selectList)                            // scan all the columns after SELECT
+            column_names->push_back(column->name);                                  // store columns which are prepared for projection
+
+        plan = new EvalPlan(new ColumnNames(*column_names), plan);                  // create a new plan for Project particular column(s)
+    }
+    return plan;
+}
+
 QueryResult *SQLExec::select(const SelectStatement *statement) {
     try {
         DbRelation& table = SQLExec::tables->get_table(statement->fromTable->name);     // get the table from SELECT command    
-        EvalPlan *plan = new EvalPlan(table);                                           // create a new TableScan plan
 
         ColumnNames* column_names = new ColumnNames;                                    // construct new ColumnNames
 	    ColumnAttributes* column_attributes = new ColumnAttributes;                     // construct new ColumnAttributes
-
-        if (statement->whereClause != nullptr)                                          // if whereClause is not nullptr
-            plan = new EvalPlan(get_where_conjunction(statement->whereClause), plan);   // create a new plan for SELECT
-
-        if (statement->selectList->at(0)->type == kExprStar) {                          // do "SELECT * from ...""
-            *column_names = table.get_column_names();                                   // get the column names of the table  
-            plan = new EvalPlan(EvalPlan::ProjectAll, plan);                            // create a new plan for ProjectAll
-        }
-        else {
-            for (auto const column : *statement->selectList)                            // scan all the columns after SELECT
-                column_names->push_back(column->name);                                  // store columns which are prepared for projection
-
-            plan = new EvalPlan(column_names, plan);                                    // create a new plan for Project particular column(s)
-        }
+        EvalPlan *plan = select_plan(statement, column_names);                          // TableScan, Select for WHERE, Project
     
-        EvalPlan *optimized = plan->optimize();                                         // attempt to get the best equivalent evaluation plan
-	    ValueDicts *rows = optimized->evaluate();                                       // evaluate the plan
+        EvalPlan *optimized = plan->optimize(SQLExec::indices, SQLExec::statistics);    // attempt to get the best equivalent evaluation plan
+	    Arena *arena = new Arena();                                                     // the rows are built here, freed with the result
+	    Rows *rows = optimized->evaluate(arena);                                        // evaluate the plan
 	    column_attributes = table.get_column_attributes(*column_names);                 // get the attributes info using column names
 
 
-    return new QueryResult(column_names, column_attributes, rows, "Successfully returned " + to_string(rows->size()) + " rows.");
+    return new QueryResult(column_names, column_attributes, rows, "Successfully returned " + to_string(rows->size()) + " rows.",
+                           arena);
 
     } catch (DbException& e) {
         throw SQLExecError(string("DbRelationError: ") + e.what());
     }
 }
 
+/**
+ANALYZE table: count its rows, blocks, and distinct values per column, and the heights of its indices
+*/
+QueryResult *SQLExec::analyze(Identifier table_name) throw(SQLExecError) {
+    if (SQLExec::tables == nullptr)
+        SQLExec::tables = new Tables();
+    if (SQLExec::indices == nullptr)
+        SQLExec::indices = new Indices();
+    if (SQLExec::statistics == nullptr)
+        SQLExec::statistics = new Statistics();
+
+    try {
+        DbRelation& table = SQLExec::tables->get_table(table_name);
+        TableStatistics stats = SQLExec::statistics->analyze(table, *SQLExec::indices);
+        return new QueryResult("analyzed " + table_name + ": " + to_string(stats.rows) + " rows in "
+                               + to_string(stats.blocks) + " blocks");
+    } catch (DbRelationError& e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+}
+
+/**
+EXPLAIN statement: the optimized plan of a SELECT or DELETE, with its estimates, without running it
+*/
+QueryResult *SQLExec::explain(const SQLStatement *statement) throw(SQLExecError) {
+    if (SQLExec::tables == nullptr)
+        SQLExec::tables = new Tables();
+    if (SQLExec::indices == nullptr)
+        SQLExec::indices = new Indices();
+    if (SQLExec::statistics == nullptr)
+        SQLExec::statistics = new Statistics();
+
+    try {
+        EvalPlan *plan;
+        ColumnNames column_names;
+        switch (statement->type()) {
+            case kStmtSelect:
+                plan = select_plan((const SelectStatement *) statement, &column_names);
+                break;
+            case kStmtDelete:
+                plan = delete_plan((const DeleteStatement *) statement);
+                break;
+            default:
+                return new QueryResult("can only explain SELECT or DELETE");
+        }
+        EvalPlan *optimized = plan->optimize(SQLExec::indices, SQLExec::statistics);
+        delete plan;
+        string text = optimized->explain();
+        delete optimized;
+        text.pop_back();  // last newline (the shell adds its own)
+        return new QueryResult(text);
+    } catch (DbRelationError& e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+}
+
 /**
 Obtain the type of column and it's attributes and data type
 */
@@ -298,6 +389,292 @@ void SQLExec::column_definition(const ColumnDefinition *col, Identifier& column_
     }
 }
 
+/**
+Storage engine for the tables created after this
+*/
+void SQLExec::set_storage_engine(Identifier storage_engine) throw(SQLExecError) {
+    if (storage_engine != Tables::HEAP && storage_engine != Tables::MMAP && storage_engine != Tables::DIRECT)
+        throw SQLExecError("unknown storage engine " + storage_engine + " (expected HEAP, MMAP, or DIRECT)");
+    SQLExec::storage_engine = storage_engine;
+}
+
+void SQLExec::set_execution(Identifier execution) throw(SQLExecError) {
+    if (execution != "ROWS" && execution != "VECTORIZED")
+        throw SQLExecError("unknown execution " + execution + " (expected ROWS or VECTORIZED)");
+    EvalPlan::vectorized = execution == "VECTORIZED";
+}
+
+/**
+IMPORT FROM CSV FILE 'file' INTO table (or TBL, with '|' between fields) is the same bulk load as COPY
+*/
+QueryResult *SQLExec::import(const ImportStatement *statement) {
+    return copy(statement->tableName, statement->filePath, statement->type == ImportStatement::kImportTbl ? '|' : ',');
+}
+
+// Bulk load input is handed to the parsing threads in pieces of about this many bytes (whole lines)
+static const size_t COPY_CHUNK_SZ = 4 * 1024 * 1024;
+
+// One piece of a bulk load's input and what became of it
+struct CopyChunk {
+    const char *begin;
+    const char *end;
+    std::vector<char*> blocks;  // packed block images, in order
+    u_long rows;
+    bool done;                  // parsed and packed (or failed, with error set)
+    string error;
+};
+
+// Split one line into its fields (double quotes around a field keep delimiters in it, "" is a quote)
+static void copy_fields(const char *begin, const char *end, char delimiter, vector<string> &fields) {
+    fields.clear();
+    const char *p = begin;
+    while (true) {
+        string field;
+        if (p < end && *p == '"') {
+            for (p++; p < end; p++) {
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"')
+                        p++;
+                    else {
+                        p++;
+                        break;
+                    }
+                }
+                field += *p;
+            }
+            while (p < end && *p != delimiter)
+                p++;
+        } else {
+            const char *stop = (const char *) memchr(p, delimiter, end - p);
+            if (stop == nullptr)
+                stop = end;
+            field.assign(p, stop);
+            p = stop;
+        }
+        fields.push_back(field);
+        if (p >= end)
+            break;
+        p++;  // past the delimiter
+    }
+}
+
+// Convert a field to a value of its column's type
+static Value copy_value(const string &field, ColumnAttribute column_attribute) {
+    switch (column_attribute.get_data_type()) {
+        case ColumnAttribute::INT: {
+            char *stop;
+            long n = strtol(field.c_str(), &stop, 10);
+            if (field.empty() || *stop != '\0' || n < INT32_MIN || n > INT32_MAX)
+                throw SQLExecError("'" + field + "' is not an INT");
+            return Value((int32_t) n);
+        }
+        case ColumnAttribute::BOOLEAN: {
+            if (field != "true" && field != "false" && field != "1" && field != "0")
+                throw SQLExecError("'" + field + "' is not a BOOLEAN");
+            Value value(field == "true" || field == "1" ? 1 : 0);
+            value.data_type = ColumnAttribute::BOOLEAN;
+            return value;
+        }
+        case ColumnAttribute::TEXT:
+        default:
+            return Value(field);
+    }
+}
+
+// Parse the lines of a chunk into rows and pack them into block images (run on a loader thread)
+static void copy_chunk(const DbRelation &table, const ColumnNames &column_names,
+                       const ColumnAttributes &column_attributes, char delimiter, CopyChunk &chunk) {
+    ValueDicts rows;
+    vector<string> fields;
+    try {
+        const char *p = chunk.begin;
+        while (p < chunk.end) {
+            const char *eol = (const char *) memchr(p, '\n', chunk.end - p);
+            if (eol == nullptr)
+                eol = chunk.end;
+            const char *line_end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+            if (line_end > p) {
+                copy_fields(p, line_end, delimiter, fields);
+                if (fields.size() != column_names.size())
+                    throw SQLExecError("line '" + string(p, line_end) + "' has " + to_string(fields.size()) +
+                                       " fields, expected " + to_string(column_names.size()));
+                ValueDict *row = new ValueDict();
+                rows.push_back(row);
+                for (uint i = 0; i < fields.size(); i++)
+                    (*row)[column_names[i]] = copy_value(fields[i], column_attributes[i]);
+            }
+            p = eol + 1;
+        }
+        table.pack(rows, chunk.blocks);
+        chunk.rows = rows.size();
+    } catch (exception &e) {
+        chunk.error = e.what();
+    }
+    for (auto const &row: rows)
+        delete row;
+}
+
+/**
+Bulk load: COPY table FROM 'file'
+The input is cut into chunks at line ends. Loader threads take the chunks in turn, parse them and pack
+the rows into block images; this thread appends each chunk's blocks to the table (and their rows to the
+table's indices) in file order. Loaders stay at most a few chunks ahead, so memory use is bounded.
+*/
+QueryResult *SQLExec::copy(Identifier table_name, string file_path, char delimiter) throw(SQLExecError) {
+    if (SQLExec::tables == nullptr)
+        SQLExec::tables = new Tables();
+    if (SQLExec::indices == nullptr)
+        SQLExec::indices = new Indices();
+    if (SQLExec::statistics == nullptr)
+        SQLExec::statistics = new Statistics();
+    // the schema tables' rows have to go through their own insert, which checks them
+    if (table_name == Tables::TABLE_NAME || table_name == Columns::TABLE_NAME || table_name == Indices::TABLE_NAME
+        || table_name == Statistics::TABLE_NAME)
+        throw SQLExecError("cannot copy into a schema table");
+    auto start = chrono::steady_clock::now();
+
+    DbRelation *table;
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    try {
+        table = &SQLExec::tables->get_table(table_name);
+        SQLExec::tables->get_columns(table_name, column_names, column_attributes);
+    } catch (DbRelationError &e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+    if (column_names.empty())
+        throw SQLExecError("no table named " + table_name);
+
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw SQLExecError("cannot open " + file_path);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw SQLExecError("cannot read " + file_path);
+    }
+    size_t file_sz = (size_t) st.st_size;
+    const char *text = nullptr;
+    if (file_sz > 0) {
+        void *mapped = mmap(nullptr, file_sz, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            throw SQLExecError("cannot read " + file_path);
+        }
+        madvise(mapped, file_sz, MADV_SEQUENTIAL);
+        text = (const char *) mapped;
+    }
+    const char *end = text + file_sz;
+
+    // skip a header line
+    const char *p = text;
+    if (file_sz > 0) {
+        const char *eol = (const char *) memchr(p, '\n', end - p);
+        if (eol == nullptr)
+            eol = end;
+        vector<string> fields;
+        copy_fields(p, (eol > p && eol[-1] == '\r') ? eol - 1 : eol, delimiter, fields);
+        if (fields == column_names)
+            p = eol < end ? eol + 1 : end;
+    }
+
+    vector<CopyChunk> chunks;
+    while (p < end) {
+        const char *stop = end - p > (ptrdiff_t) COPY_CHUNK_SZ ? p + COPY_CHUNK_SZ : end;
+        if (stop < end) {
+            const char *eol = (const char *) memchr(stop, '\n', end - stop);
+            stop = eol == nullptr ? end : eol + 1;
+        }
+        CopyChunk chunk;
+        chunk.begin = p;
+        chunk.end = stop;
+        chunk.rows = 0;
+        chunk.done = false;
+        chunks.push_back(chunk);
+        p = stop;
+    }
+
+    uint n_threads = max(1U, min(thread::hardware_concurrency(), (uint) chunks.size()));
+    size_t window = 2 * n_threads;  // chunks parsed but not yet appended, at most
+    mutex m;
+    condition_variable cv;
+    size_t next = 0;                // next chunk for a loader to take
+    size_t appended = 0;            // chunks appended so far
+    vector<thread> loaders;
+    for (uint t = 0; t < n_threads; t++)
+        loaders.push_back(thread([&]() {
+            while (true) {
+                size_t i;
+                {
+                    unique_lock<mutex> lock(m);
+                    cv.wait(lock, [&]() { return next >= chunks.size() || next < appended + window; });
+                    if (next >= chunks.size())
+                        return;
+                    i = next++;
+                }
+                copy_chunk(*table, column_names, column_attributes, delimiter, chunks[i]);
+                {
+                    lock_guard<mutex> lock(m);
+                    chunks[i].done = true;
+                }
+                cv.notify_all();
+            }
+        }));
+
+    auto index_names = SQLExec::indices->get_index_names(table_name);
+    u_long n = 0;
+    u_long n_blocks = 0;
+    string error;
+    for (size_t i = 0; i < chunks.size() && error.empty(); i++) {
+        {
+            unique_lock<mutex> lock(m);
+            cv.wait(lock, [&]() { return chunks[i].done; });
+        }
+        error = chunks[i].error;
+        if (error.empty()) {
+            try {
+                Handles *handles = table->append_blocks(chunks[i].blocks);
+                for (auto const &index_name: index_names)
+                    SQLExec::indices->get_index(table_name, index_name).insert(handles);
+                delete handles;
+                n += chunks[i].rows;
+                n_blocks += chunks[i].blocks.size();
+            } catch (exception &e) {
+                error = e.what();
+            }
+        }
+        for (auto const &block: chunks[i].blocks)
+            delete[] block;
+        chunks[i].blocks.clear();
+        {
+            lock_guard<mutex> lock(m);
+            appended++;
+            if (!error.empty())
+                next = chunks.size();  // loaders stop
+        }
+        cv.notify_all();
+    }
+    for (auto &loader: loaders)
+        loader.join();
+    for (auto &chunk: chunks)
+        for (auto const &block: chunk.blocks)
+            delete[] block;
+    if (text != nullptr)
+        munmap((void *) text, file_sz);
+    close(fd);
+    if (!error.empty())
+        throw SQLExecError("COPY " + table_name + " stopped after " + to_string(n) + " rows: " + error);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (seconds <= 0)
+        seconds = 1e-9;
+    char rates[80];
+    snprintf(rates, sizeof(rates), "%.3f s, %.0f rows/s, %.1f MB/s", seconds, n / seconds,
+             file_sz / seconds / (1024 * 1024));
+    return new QueryResult("successfully copied " + to_string(n) + " rows (" + to_string(n_blocks) +
+                           " blocks) into " + table_name + " with " + to_string(n_threads) + " threads in " + rates);
+}
+
 /**
 Create statement for SQL, currently limited to Create Table & Create Index
 */
@@ -331,6 +708,7 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement) {
     // Add to schema: _tables and _columns
     ValueDict row;
     row["table_name"] = table_name;
+    row["storage_engine"] = SQLExec::storage_engine;
     Handle t_handle = SQLExec::tables->insert(&row);  // Insert into _tables
     try {
         Handles c_handles;
@@ -439,7 +817,8 @@ USE: DROP TABLE tablename
 */
 QueryResult *SQLExec::drop_table(const DropStatement *statement) {
     Identifier table_name = statement->name;
-    if (table_name == Tables::TABLE_NAME || table_name == Columns::TABLE_NAME)
+    if (table_name == Tables::TABLE_NAME || table_name == Columns::TABLE_NAME || table_name == Indices::TABLE_NAME
+        || table_name == Statistics::TABLE_NAME)
         throw SQLExecError("cannot drop a schema table");
 
     ValueDict where;
@@ -471,6 +850,9 @@ QueryResult *SQLExec::drop_table(const DropStatement *statement) {
         columns.del(handle);
     delete handles;
 
+    // forget its statistics
+    SQLExec::statistics->forget(table_name);
+
     // remove table
     table.drop();
 
@@ -542,9 +924,10 @@ QueryResult *SQLExec::show_index(const ShowStatement *statement) {
     where["table_name"] = Value(statement->tableName);
     Handles* handles = SQLExec::indices->select(&where);
 
-    ValueDicts* rows = new ValueDicts;
+    RowSchema schema = make_shared<const ColumnNames>(*column_names);  // shared by all the rows
+    Rows* rows = new Rows;
     for (auto const& handle: *handles) {
-        ValueDict* row = SQLExec::indices->project(handle, column_names); 
+        Row* row = SQLExec::indices->project(handle, schema); 
         rows->push_back(row);
     }                                                   
     string result = "successfully returned " + to_string(rows->size()) + " rows";
@@ -565,11 +948,13 @@ QueryResult *SQLExec::show_tables() {
     Handles* handles = SQLExec::tables->select();
     u_long n = handles->size() - 2;
 
-    ValueDicts* rows = new ValueDicts;
+    RowSchema schema = make_shared<const ColumnNames>(*column_names);
+    Rows* rows = new Rows;
     for (auto const& handle: *handles) {
-        ValueDict* row = SQLExec::tables->project(handle, column_names);
+        Row* row = SQLExec::tables->project(handle, schema);
         Identifier table_name = row->at("table_name").s;
-        if (table_name != Tables::TABLE_NAME && table_name != Columns::TABLE_NAME)
+        if (table_name != Tables::TABLE_NAME && table_name != Columns::TABLE_NAME
+            && table_name != Statistics::TABLE_NAME)
             rows->push_back(row);
     }
     delete handles;
@@ -595,9 +980,10 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
     Handles* handles = columns.select(&where);
     u_long n = handles->size();
 
-    ValueDicts* rows = new ValueDicts;
+    RowSchema schema = make_shared<const ColumnNames>(*column_names);
+    Rows* rows = new Rows;
     for (auto const& handle: *handles) {
-        ValueDict* row = columns.project(handle, column_names);
+        Row* row = columns.project(handle, schema);
         rows->push_back(row);
     }
     delete handles;
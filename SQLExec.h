@@ -10,6 +10,8 @@
 #include "SQLParser.h"
 #include "schema_tables.h"
 
+class EvalPlan;
+
 /**
  * @class SQLExecError - exception for SQLExec methods
  */
@@ -24,27 +26,30 @@ public:
  */
 class QueryResult {
 public:
-    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), message("") {}
+    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), message(""), arena(nullptr) {}
 
     QueryResult(std::string message) : column_names(nullptr), column_attributes(nullptr), rows(nullptr),
-                                       message(message) {}
+                                       message(message), arena(nullptr) {}
 
-    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueDicts *rows, std::string message)
-            : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message) {}
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, Rows *rows, std::string message,
+                Arena *arena=nullptr)
+            : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message),
+              arena(arena) {}
 
     virtual ~QueryResult();
 
     ColumnNames *get_column_names() const { return column_names; }
     ColumnAttributes *get_column_attributes() const { return column_attributes; }
-    ValueDicts *get_rows() const { return rows; }
+    Rows *get_rows() const { return rows; }
     const std::string &get_message() const { return message; }
     friend std::ostream &operator<<(std::ostream &stream, const QueryResult &qres);
 
 protected:
     ColumnNames *column_names;
     ColumnAttributes *column_attributes;
-    ValueDicts *rows;
+    Rows *rows;
     std::string message;
+    Arena *arena;  // the rows were built in (and go with) this, if not nullptr
 };
 
 
@@ -60,10 +65,54 @@ public:
      */
     static QueryResult *execute(const hsql::SQLStatement *statement) throw(SQLExecError);
 
+    /**
+     * Choose how the blocks of tables created from now on are stored (recorded per table in _tables).
+     * @param storage_engine  Tables::HEAP, Tables::MMAP, or Tables::DIRECT
+     */
+    static void set_storage_engine(Identifier storage_engine) throw(SQLExecError);
+
+    /**
+     * Choose how plans are evaluated from now on: a row at a time, or a DataChunk of rows at a time.
+     * @param execution  "ROWS" or "VECTORIZED"
+     */
+    static void set_execution(Identifier execution) throw(SQLExecError);
+
+    /**
+     * Bulk load a table: COPY <table_name> FROM '<file_path>'.
+     * The file has one row per line with the fields in column order, separated by delimiter (a field
+     * may be in double quotes, with "" for a quote, but not span lines). A first line naming the
+     * columns is skipped. Lines are parsed and packed into blocks on several threads, and the
+     * blocks are appended to the table whole.
+     * @param table_name  table to load
+     * @param file_path   file to load it from
+     * @param delimiter   field separator (',' for CSV, '|' for TBL)
+     * @returns           the query result, with the load's throughput (freed by caller)
+     */
+    static QueryResult *copy(Identifier table_name, std::string file_path, char delimiter=',') throw(SQLExecError);
+
+    /**
+     * Gather a table's statistics (rows, blocks, distinct values per column, index heights) into
+     * _statistics, for the optimizer to cost its access paths with: ANALYZE <table_name>.
+     * @param table_name  table to analyze
+     * @returns           the query result (freed by caller)
+     */
+    static QueryResult *analyze(Identifier table_name) throw(SQLExecError);
+
+    /**
+     * Show the plan a SELECT or DELETE would be evaluated with, with the optimizer's estimates: EXPLAIN <statement>.
+     * @param statement  the Hyrise AST of the statement to explain (not executed)
+     * @returns          the query result, with the plan as its message (freed by caller)
+     */
+    static QueryResult *explain(const hsql::SQLStatement *statement) throw(SQLExecError);
+
 protected:
-    // the one place in the system that holds the _tables table and _indices table
+    // the one place in the system that holds the _tables table, _indices table, and _statistics table
     static Tables *tables;
     static Indices *indices;
+    static Statistics *statistics;
+
+    // storage engine for CREATE TABLE
+    static Identifier storage_engine;
 
     // recursive decent into the AST
     static QueryResult *create(const hsql::CreateStatement *statement);
@@ -82,6 +131,11 @@ protected:
     static QueryResult *insert(const hsql::InsertStatement *statement);
     static QueryResult *del(const hsql::DeleteStatement *statement);
     static QueryResult *select(const hsql::SelectStatement *statement);
+    static QueryResult *import(const hsql::ImportStatement *statement);
+
+    // the (unoptimized) plans of SELECT and DELETE; select_plan also gets the names of the columns selected
+    static EvalPlan *select_plan(const hsql::SelectStatement *statement, ColumnNames *column_names);
+    static EvalPlan *delete_plan(const hsql::DeleteStatement *statement);
     
     /**
      * Pull out column name and attributes from AST's column definition clause
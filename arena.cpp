@@ -0,0 +1,94 @@
+/**
+ * @file arena.cpp - implementation of:
+ * Arena
+ */
+#include <stdlib.h>
+#include <atomic>
+#include <string>
+#include "arena.h"
+
+using namespace std;
+
+#ifdef COUNT_ALLOCATIONS
+static atomic<uint64_t> allocation_count(0);
+
+void* operator new(size_t size) {
+	allocation_count++;
+	void* p = malloc(size == 0 ? 1 : size);
+	if (p == nullptr)
+		throw bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+uint64_t heap_allocations() {
+	return allocation_count;
+}
+#else
+uint64_t heap_allocations() {
+	return 0;
+}
+#endif
+
+// Start with one chunk, so allocate() always has one to bump through.
+Arena::Arena() : chunks(), next(nullptr), end(nullptr), allocated(0), destructors(nullptr) {
+	this->next = new char[CHUNK_SZ];
+	this->end = this->next + CHUNK_SZ;
+	this->chunks.push_back(this->next);
+}
+
+// Destroy the objects made here, newest first (they may refer to older ones), then free the chunks.
+Arena::~Arena() {
+	for (Destructor* destructor = this->destructors; destructor != nullptr; destructor = destructor->next)
+		destructor->destroy(destructor->object);
+	for (auto const& chunk: this->chunks)
+		delete[] chunk;
+}
+
+// The current chunk is full: start a new one. A request too big for a chunk gets one of its own, and
+// the current chunk stays current.
+void* Arena::grow(size_t size, size_t align) {
+	size_t chunk_sz = size + align;
+	if (chunk_sz > CHUNK_SZ / 4) {
+		char* chunk = new char[chunk_sz];
+		this->chunks.push_back(chunk);
+		this->allocated += size;
+		return (void*)(((uintptr_t)chunk + align - 1) & ~(uintptr_t)(align - 1));
+	}
+	this->next = new char[CHUNK_SZ];
+	this->end = this->next + CHUNK_SZ;
+	this->chunks.push_back(this->next);
+	return allocate(size, align);
+}
+
+// test function -- returns true if all tests pass
+bool test_arena() {
+	static int destroyed = 0;
+	struct Counted {
+		string s;
+		Counted(string s) : s(s) {}
+		~Counted() {destroyed++;}
+	};
+
+	bool ok = true;
+	{
+		Arena arena;
+		vector<Counted*> made;
+		for (int i = 0; i < 10000; i++)
+			made.push_back(arena.make<Counted>(string(i % 100, 'x')));  // some too long to fit in the string
+		for (int i = 0; i < 10000; i++)
+			ok = ok && made[i]->s == string(i % 100, 'x') && (uintptr_t)made[i] % alignof(Counted) == 0;
+		char* big = (char*)arena.allocate(Arena::CHUNK_SZ * 2, 64);
+		ok = ok && (uintptr_t)big % 64 == 0;
+		big[Arena::CHUNK_SZ * 2 - 1] = 'x';
+
+		vector<int, ArenaAllocator<int>> numbers{ArenaAllocator<int>(&arena)};
+		for (int i = 0; i < 1000; i++)
+			numbers.push_back(i);
+		ok = ok && numbers[999] == 999 && arena.get_chunks() > 1 && arena.get_allocated() > Arena::CHUNK_SZ * 2;
+	}
+	return ok && destroyed == 10000;
+}
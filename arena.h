@@ -0,0 +1,135 @@
+/**
+ * @file arena.h - memory for the objects of one statement, freed all at once
+ * Arena
+ * ArenaAllocator
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * @class Arena - monotonic bump allocator
+ *
+ * Memory is handed out from CHUNK_SZ chunks by bumping a pointer, and is never given back one piece
+ * at a time: the whole arena goes when it is deleted. Objects built with make() have their destructors
+ * run then (newest first), so whatever they hold outside the arena (e.g., a long std::string) is freed
+ * too; the bookkeeping for that is kept in the arena alongside the object.
+ *
+ * A statement's results (e.g., the Rows of a SELECT) are built in an arena owned by its QueryResult.
+ */
+class Arena {
+public:
+	/**
+	 * Size of the chunks memory is handed out from (a bigger request gets a chunk of its own).
+	 */
+	static const size_t CHUNK_SZ = 64 * 1024;
+
+	Arena();
+	virtual ~Arena();
+	Arena(const Arena& other) = delete;
+	Arena(Arena&& temp) = delete;
+	Arena& operator=(const Arena& other) = delete;
+	Arena& operator=(Arena&& temp) = delete;
+
+	/**
+	 * Get some memory, good until the arena is deleted.
+	 * @param size   bytes wanted
+	 * @param align  alignment wanted (a power of 2)
+	 * @returns      the memory
+	 */
+	void* allocate(size_t size, size_t align=alignof(std::max_align_t)) {
+		char* at = (char*)(((uintptr_t)this->next + align - 1) & ~(uintptr_t)(align - 1));
+		if (at + size > this->end)
+			return grow(size, align);
+		this->next = at + size;
+		this->allocated += size;
+		return at;
+	}
+
+	/**
+	 * Build an object in the arena. Its destructor is run when the arena is deleted.
+	 * @param args  constructor arguments
+	 * @returns     the object (not to be deleted)
+	 */
+	template<typename T, typename... Args>
+	T* make(Args&&... args) {
+		Destructor* destructor = (Destructor*)allocate(sizeof(Destructor), alignof(Destructor));
+		T* object = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		destructor->destroy = [](void* p) {((T*)p)->~T();};
+		destructor->object = object;
+		destructor->next = this->destructors;
+		this->destructors = destructor;
+		return object;
+	}
+
+	/**
+	 * @returns  bytes handed out so far
+	 */
+	size_t get_allocated() const {return allocated;}
+
+	/**
+	 * @returns  number of chunks taken from the heap so far
+	 */
+	size_t get_chunks() const {return chunks.size();}
+
+protected:
+	struct Destructor {
+		Destructor* next;
+		void (*destroy)(void*);
+		void* object;
+	};
+
+	std::vector<char*> chunks;
+	char* next;                // next free byte of the current chunk
+	char* end;                 // end of the current chunk
+	size_t allocated;
+	Destructor* destructors;   // newest first
+
+	virtual void* grow(size_t size, size_t align);
+};
+
+/**
+ * @class ArenaAllocator - standard allocator taking memory from an Arena (or the heap if there is none)
+ *
+ * A container using it can live in an arena or not: deallocate() does nothing for arena memory, which
+ * is freed with the arena.
+ */
+template<typename T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+
+	ArenaAllocator(Arena* arena=nullptr) : arena(arena) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t n) {
+		if (this->arena != nullptr)
+			return (T*)this->arena->allocate(n * sizeof(T), alignof(T));
+		return (T*)::operator new(n * sizeof(T));
+	}
+
+	void deallocate(T* p, size_t n) {
+		if (this->arena == nullptr)
+			::operator delete(p);
+	}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const {return arena == other.arena;}
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const {return arena != other.arena;}
+
+	Arena* arena;
+};
+
+/**
+ * Number of calls to operator new so far, if the program was built with -DCOUNT_ALLOCATIONS to count
+ * them (otherwise 0).
+ */
+uint64_t heap_allocations();
+
+bool test_arena();
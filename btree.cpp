@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "btree.h"
 using namespace std;
 
@@ -26,11 +27,9 @@ void BTreeIndex::create() {
 	this->closed = false;
 
 	// now build the index! -- add every row from relation into index
-	Handles* handles = this->relation.select();
-	for (auto const& handle : *handles) {
-    // Insert row from relation into the index
-		this->insert(handle);
-	}
+	Handles* handles = this->relation.select(nullptr, DbFile::SEQUENTIAL);
+	this->insert(handles);
+	delete handles;
 }
 
 // Drop the index.
@@ -58,34 +57,45 @@ void BTreeIndex::open() {
 
 // Closes the index. Disables: lookup, range, insert, delete, update.
 void BTreeIndex::close() {
+	delete this->stat;
+	delete this->root;
 	this->file.close();
 	this->stat = nullptr;
 	this->root = nullptr;
 	this->closed = true;
 }
 
+// Levels from the root down to the leaves, as kept in the stat block.
+uint BTreeIndex::get_height() {
+	open();
+	return this->stat->get_height();
+}
+
 // Find all the rows whose columns are equal to key. Assumes key is a dictionary whose keys are the column
 // names in the index. Returns a list of row handles.
 Handles* BTreeIndex::lookup(ValueDict* key_dict) const {
 	KeyValue* _tKey = this->tkey(key_dict);
-	return this->_lookup(this->root, this->stat->get_height(), _tKey);
+	Handles* handles = this->_lookup(this->root, this->stat->get_height(), _tKey);
+	delete _tKey;
+	return handles;
 }
 
 // Recursive helper function for lookup
 Handles* BTreeIndex::_lookup(BTreeNode *node, uint height, const KeyValue* key) const {
-	Handles* handles = new Handles();
-	Handle handle;
 	if (height == 1) {
-		handle = ((BTreeLeaf*)node)->find_eq(key);
+		Handles* handles = new Handles();
+		Handle handle = ((BTreeLeaf*)node)->find_eq(key);
 		if (handle.first)
 			handles->push_back(handle);
 		return handles;
 	}
 	else {
     // Search for the key in the node, use the returned node as the root of
-    // the next search
-		return _lookup(((BTreeInterior*)node)->find(key, this->stat->get_height()),
-													this->stat->get_height() - 1, key);
+    // the next search (child nodes hold a pinned block, so let go of them when done)
+		BTreeNode* child = ((BTreeInterior*)node)->find(key, height);
+		Handles* handles = _lookup(child, height - 1, key);
+		delete child;
+		return handles;
 	}
 }
 
@@ -96,7 +106,34 @@ Handles* BTreeIndex::range(ValueDict* min_key, ValueDict* max_key) const {
 
 // Insert a row with the given handle. Row must exist in relation already.
 void BTreeIndex::insert(Handle handle) {
-	KeyValue* _tKey = this->tkey(this->relation.project(handle, &key_columns));
+	Row* row = this->relation.project(handle, &key_columns);
+	KeyValue* _tKey = this->tkey(row);
+	delete row;
+	insert_key(_tKey, handle);
+	delete _tKey;
+}
+
+// Insert a batch of rows. The keys are put in order first, so that consecutive insertions
+// go down the same path to the same leaf (whose blocks are then still in the buffer pool).
+void BTreeIndex::insert(const Handles* handles) {
+	vector<pair<KeyValue, Handle>> entries;
+	entries.reserve(handles->size());
+	RowSchema key_schema = make_shared<const ColumnNames>(key_columns);
+	for (auto const& handle: *handles) {
+		Row* row = this->relation.project(handle, key_schema);
+		KeyValue* _tKey = this->tkey(row);
+		delete row;
+		entries.push_back(make_pair(*_tKey, handle));
+		delete _tKey;
+	}
+	sort(entries.begin(), entries.end(),
+		 [](const pair<KeyValue, Handle>& a, const pair<KeyValue, Handle>& b) {return a.first < b.first;});
+	for (auto const& entry: entries)
+		insert_key(&entry.first, entry.second);
+}
+
+// Insert the key for a row, splitting the root if it comes to that.
+void BTreeIndex::insert_key(const KeyValue* _tKey, Handle handle) {
 	Insertion split_root = _insert(this->root, this->stat->get_height(), _tKey, handle);
 
   // If split root is not none, the another node needs to be added
@@ -117,6 +154,7 @@ void BTreeIndex::insert(Handle handle) {
 		this->stat->save();
 
     // Set root equal to the new root
+		delete this->root;
 		this->root = root;
 	}
 }
@@ -129,7 +167,9 @@ Insertion BTreeIndex::_insert(BTreeNode *node, uint height, const KeyValue* key,
 		insertion = ((BTreeLeaf*)node)->insert(key, handle);
 	else {
     // Else we need to recursively insert into the next level down
-		Insertion new_kid = _insert(((BTreeInterior*)node)->find(key, height), height - 1, key, handle);
+		BTreeNode* child = ((BTreeInterior*)node)->find(key, height);
+		Insertion new_kid = _insert(child, height - 1, key, handle);
+		delete child;
 
     // If something bubbles up, we must insert the new kid's information into
     // the current interior node
@@ -143,6 +183,11 @@ void BTreeIndex::del(Handle handle) {
     throw DbRelationError("Don't know how to delete from a BTree index yet");
 }
 
+// A row projected on the key columns already has its values in key order.
+KeyValue *BTreeIndex::tkey(const Row *row) const {
+	return new KeyValue(row->begin(), row->end());
+}
+
 // Transform a key dictionary into a tuple in the correct order.
 KeyValue *BTreeIndex::tkey(const ValueDict *key) const {
 	KeyValue *keyValue = new KeyValue();
@@ -231,7 +276,7 @@ bool test_btree() {
 	}
 	else {
 		for (auto const& handle : *handles1) {
-			ValueDict* result_row = testTable.project(handle);
+			Row* result_row = testTable.project(handle);
 			if ((*result_row)["a"] == test_row1["a"] &&
                 (*result_row)["b"] == test_row1["b"]) {
 				result = true;
@@ -253,7 +298,7 @@ bool test_btree() {
 	}
 	else {
 		for (auto const& handle : *handles2) {
-			ValueDict* result_row = testTable.project(handle);
+			Row* result_row = testTable.project(handle);
 			if ((*result_row)["a"] == test_row2["a"] &&
                 (*result_row)["b"] == test_row2["b"]) {
 				result = true;
@@ -275,7 +320,7 @@ bool test_btree() {
 	}
 	else {
 		for (auto const& handle : *handles3) {
-			ValueDict* result_row = testTable.project(handle);
+			Row* result_row = testTable.project(handle);
 			if ((*result_row)["a"] == test_row3["a"] &&
                 (*result_row)["b"] == test_row3["b"]) {
               result = false;
@@ -297,7 +342,7 @@ bool test_btree() {
 		}
 		else {
 			for (auto const& handle : *handles4) {
-				ValueDict* result_row = testTable.project(handle);
+				Row* result_row = testTable.project(handle);
 				if ((*result_row)["a"] == test_row4["a"]&&
                     (*result_row)["b"] == test_row4["b"]) {
                   result = true;
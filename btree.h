@@ -17,9 +17,12 @@ public:
     virtual Handles* range(ValueDict* min_key, ValueDict* max_key) const;
 
     virtual void insert(Handle handle);
+    virtual void insert(const Handles* handles);
     virtual void del(Handle handle);
+    virtual uint get_height();
 
     virtual KeyValue *tkey(const ValueDict *key) const; // pull out the key values from the ValueDict in order
+    virtual KeyValue *tkey(const Row *row) const; // the values of a row projected on the key columns
 
 protected:
     static const BlockID STAT = 1;
@@ -32,6 +35,7 @@ protected:
     void build_key_profile();
     Handles* _lookup(BTreeNode *node, uint height, const KeyValue* key) const;
     Insertion _insert(BTreeNode *node, uint height, const KeyValue* key, Handle handle);
+    void insert_key(const KeyValue* key, Handle handle);
 };
 
 bool test_btree();
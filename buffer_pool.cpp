@@ -0,0 +1,221 @@
+/**
+ * @file buffer_pool.cpp - implementation of:
+ * BufferPool
+ */
+#include <stdlib.h>
+#include <memory.h>
+#include <algorithm>
+#include <vector>
+#include "buffer_pool.h"
+#include "heap_storage.h"
+
+BufferPool& BufferPool::pool() {
+	static BufferPool the_pool(FRAMES);
+	return the_pool;
+}
+
+BufferPool::BufferPool(uint frames) : nframes(frames), memory(nullptr), frames(nullptr), hand(0), table() {
+	// block-aligned so the frames can be handed straight to the OS for I/O
+	void* mem = nullptr;
+	if (posix_memalign(&mem, DbBlock::BLOCK_SZ, (size_t)frames * DbBlock::BLOCK_SZ) != 0)
+		throw DbRelationError("cannot allocate buffer pool");
+	this->memory = (char*)mem;
+	this->frames = new BufferFrame[frames];
+	for (uint i = 0; i < frames; i++)
+		this->frames[i].data = this->memory + (size_t)i * DbBlock::BLOCK_SZ;
+	this->table.reserve(frames);
+}
+
+BufferPool::~BufferPool() {
+	delete[] this->frames;
+	free(this->memory);
+}
+
+// Find the cached block or read it into a victim frame.
+// A scan with a ring neither counts as a reference to a cached block nor marks what it reads
+// as referenced, so its blocks are the first to go.
+BufferFrame* BufferPool::pin(HeapFile* file, BlockID block_id, BufferRing* ring) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	auto found = this->table.find(FrameKey(file, block_id));
+	if (found != this->table.end()) {
+		BufferFrame* frame = &this->frames[found->second];
+		frame->pin_count++;
+		if (ring == nullptr)
+			frame->referenced = true;
+		return frame;
+	}
+	BufferFrame* frame = ring == nullptr ? victim() : ring_victim(ring);
+	file->read_block(block_id, frame->data);
+	assign(frame, file, block_id, ring);
+	frame->pin_count = 1;
+	frame->referenced = ring == nullptr;
+	return frame;
+}
+
+// Like pin, but the block is brand new so there is nothing to read.
+BufferFrame* BufferPool::pin_new(HeapFile* file, BlockID block_id) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	auto found = this->table.find(FrameKey(file, block_id));
+	BufferFrame* frame = found != this->table.end() ? &this->frames[found->second] : victim();
+	memset(frame->data, 0, DbBlock::BLOCK_SZ);
+	frame->file = file;
+	frame->block_id = block_id;
+	frame->pin_count++;
+	frame->dirty = false;
+	frame->referenced = true;
+	this->table[FrameKey(file, block_id)] = (uint)(frame - this->frames);
+	return frame;
+}
+
+bool BufferPool::cached(const HeapFile* file, BlockID block_id) const {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	return this->table.count(FrameKey(file, block_id)) > 0;
+}
+
+// Copy a block that came in with a read-ahead into a victim frame, unless it is already here
+// (in which case the cached copy may well be newer).
+void BufferPool::prefetched(HeapFile* file, BlockID block_id, const void* data, BufferRing* ring) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	if (cached(file, block_id))
+		return;
+	BufferFrame* frame = claim(file, block_id, ring);
+	memcpy(frame->data, data, DbBlock::BLOCK_SZ);
+	install(frame, file, block_id);
+}
+
+// The ring (if any) notes the block now, since the scan that owns it may be gone by the time the
+// read completes.
+BufferFrame* BufferPool::claim(HeapFile* file, BlockID block_id, BufferRing* ring) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	BufferFrame* frame = ring == nullptr ? victim() : ring_victim(ring);
+	if (ring != nullptr) {
+		ring->files[ring->next] = file;
+		ring->block_ids[ring->next] = block_id;
+	}
+	frame->pin_count = 1;
+	frame->dirty = false;
+	frame->referenced = false;
+	return frame;
+}
+
+void BufferPool::install(BufferFrame* frame, HeapFile* file, BlockID block_id) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	frame->pin_count = 0;
+	if (!cached(file, block_id))  // else someone got the block in by another route meanwhile
+		assign(frame, file, block_id, nullptr);
+}
+
+void BufferPool::abandon(BufferFrame* frame) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	frame->pin_count = 0;
+}
+
+void BufferPool::unpin(BufferFrame* frame) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	if (frame->pin_count > 0)
+		frame->pin_count--;
+}
+
+void BufferPool::mark_dirty(BufferFrame* frame) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	if (frame->file != nullptr)
+		frame->dirty = true;
+}
+
+// Write back this file's dirty blocks (they stay cached), all in one batch.
+void BufferPool::flush(HeapFile* file) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	std::vector<BufferFrame*> dirty_frames;
+	for (uint i = 0; i < this->nframes; i++)
+		if (this->frames[i].file == file && this->frames[i].dirty)
+			dirty_frames.push_back(&this->frames[i]);
+	if (dirty_frames.empty())
+		return;
+	file->write_blocks(dirty_frames);
+	for (auto const& frame: dirty_frames)
+		frame->dirty = false;
+}
+
+void BufferPool::flush_all() {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	std::vector<HeapFile*> files;
+	for (uint i = 0; i < this->nframes; i++)
+		if (this->frames[i].file != nullptr && this->frames[i].dirty
+				&& std::find(files.begin(), files.end(), this->frames[i].file) == files.end())
+			files.push_back(this->frames[i].file);
+	for (auto const& file: files)
+		flush(file);
+}
+
+// Drop this file's blocks from the pool without writing them.
+void BufferPool::release(HeapFile* file) {
+	std::lock_guard<std::recursive_mutex> guard(this->latch_mutex);
+	for (uint i = 0; i < this->nframes; i++) {
+		BufferFrame* frame = &this->frames[i];
+		if (frame->file == file) {
+			this->table.erase(FrameKey(file, frame->block_id));
+			frame->file = nullptr;
+			frame->dirty = false;
+			frame->referenced = false;
+		}
+	}
+}
+
+// Clock replacement: sweep past frames, giving referenced ones a second chance,
+// until an unpinned frame turns up. Writes it back if dirty and unmaps it.
+BufferFrame* BufferPool::victim() {
+	for (uint tries = 0; tries < 2 * this->nframes; tries++) {
+		BufferFrame* frame = &this->frames[this->hand];
+		this->hand = (this->hand + 1) % this->nframes;
+		if (frame->pin_count > 0)
+			continue;
+		if (frame->referenced) {
+			frame->referenced = false;
+			continue;
+		}
+		evict(frame);
+		return frame;
+	}
+	throw DbRelationError("buffer pool is full: every frame is pinned");
+}
+
+// Reuse the ring's oldest frame if it still holds the block the ring read into it and nobody
+// else is using it; otherwise take a frame from the clock and make it part of the ring.
+BufferFrame* BufferPool::ring_victim(BufferRing* ring) {
+	ring->next = (ring->next + 1) % BufferRing::SIZE;
+	BufferFrame* frame = ring->slots[ring->next];
+	if (frame == nullptr || frame->pin_count > 0 || frame->referenced
+			|| frame->file != ring->files[ring->next] || frame->block_id != ring->block_ids[ring->next])
+		frame = victim();
+	else
+		evict(frame);
+	ring->slots[ring->next] = frame;
+	return frame;
+}
+
+// Write back the frame's block if dirty and forget which block it held.
+void BufferPool::evict(BufferFrame* frame) {
+	if (frame->file != nullptr) {
+		if (frame->dirty)
+			write_back(frame);
+		this->table.erase(FrameKey(frame->file, frame->block_id));
+		frame->file = nullptr;
+	}
+}
+
+// Map a victim frame, just filled with the given block, to it.
+void BufferPool::assign(BufferFrame* frame, HeapFile* file, BlockID block_id, BufferRing* ring) {
+	frame->file = file;
+	frame->block_id = block_id;
+	frame->dirty = false;
+	this->table[FrameKey(file, block_id)] = (uint)(frame - this->frames);
+	if (ring != nullptr) {
+		ring->files[ring->next] = file;
+		ring->block_ids[ring->next] = block_id;
+	}
+}
+
+void BufferPool::write_back(BufferFrame* frame) {
+	frame->file->write_block(frame->block_id, frame->data);
+	frame->dirty = false;
+}
@@ -0,0 +1,204 @@
+/**
+ * @file buffer_pool.h - cache of database blocks in front of HeapFile
+ * BufferFrame
+ * BufferPool
+ */
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include "storage_engine.h"
+
+class HeapFile;
+
+/**
+ * @class BufferFrame - one block-sized slot in the buffer pool
+ */
+class BufferFrame {
+public:
+	BufferFrame() : data(nullptr), file(nullptr), block_id(0), pin_count(0), dirty(false), referenced(false) {}
+
+	char* data;          // DbBlock::BLOCK_SZ bytes of block memory
+	HeapFile* file;      // file this block belongs to (nullptr if the frame is free)
+	BlockID block_id;
+	uint pin_count;      // number of SlottedPages currently using this frame
+	bool dirty;          // must be written back before the frame is reused
+	bool referenced;     // used since the clock hand last passed
+};
+
+/**
+ * @class BufferRing - the few frames a sequential scan keeps reusing for itself
+ *
+ * A scan passing a ring to BufferPool::pin reads each missing block into the oldest frame of
+ * its ring (as long as nobody else has started using that frame), so a pass over a big table
+ * only ever displaces SIZE frames worth of other blocks.
+ */
+class BufferRing {
+	friend class BufferPool;
+public:
+	static const uint SIZE = 32;
+
+	BufferRing() : next(0) {
+		for (uint i = 0; i < SIZE; i++)
+			slots[i] = nullptr;
+	}
+
+protected:
+	BufferFrame* slots[SIZE];  // frames this ring has read blocks into
+	HeapFile* files[SIZE];     // ... and what they read, to notice if the frame has been reused since
+	BlockID block_ids[SIZE];
+	uint next;                 // oldest slot
+};
+
+/**
+ * @class BufferPool - fixed array of frames caching blocks from HeapFiles
+ *
+ * Blocks are pinned while a SlottedPage is using them and unpinned when it is deleted. A pinned
+ * frame is never reused. Unpinned frames are replaced using the clock algorithm, and dirty ones are
+ * written back to their HeapFile first. Writes to a block just mark its frame dirty; the block
+ * reaches the file on eviction, HeapFile::close(), or flush_all().
+ *
+ * Sequential scans pass a BufferRing so they recycle their own frames instead of evicting the
+ * hot blocks (schema tables, index nodes) that everyone else is using.
+ *
+ * Each method holds the pool's latch, so several threads (e.g., the workers of a parallel scan) can
+ * pin and unpin at once. A miss reads its block with the latch held, which also keeps the Berkeley DB
+ * handles (not opened free-threaded) to one thread at a time.
+ */
+class BufferPool {
+public:
+	/**
+	 * Number of frames in the pool (4MB of blocks).
+	 */
+	static const uint FRAMES = 1024;
+
+	/**
+	 * The one buffer pool shared by all HeapFiles.
+	 */
+	static BufferPool& pool();
+
+	BufferPool(uint frames);
+	virtual ~BufferPool();
+	BufferPool(const BufferPool& other) = delete;
+	BufferPool(BufferPool&& temp) = delete;
+	BufferPool& operator=(const BufferPool& other) = delete;
+	BufferPool& operator=(BufferPool&& temp) = delete;
+
+	/**
+	 * Pin the frame holding the given block, reading the block in if it is not already cached.
+	 * @param file      file the block is in
+	 * @param block_id  which block
+	 * @param ring      frames to recycle for a sequential scan (nullptr for normal access)
+	 * @returns         pinned frame (caller must unpin)
+	 */
+	virtual BufferFrame* pin(HeapFile* file, BlockID block_id, BufferRing* ring=nullptr);
+
+	/**
+	 * Pin a zero-filled frame for a block that is being newly added to the file (nothing is read).
+	 * @param file      file the block is in
+	 * @param block_id  which block
+	 * @returns         pinned frame (caller must unpin)
+	 */
+	virtual BufferFrame* pin_new(HeapFile* file, BlockID block_id);
+
+	/**
+	 * Is the given block in the pool?
+	 * @param file      file the block is in
+	 * @param block_id  which block
+	 * @returns         true if it is cached
+	 */
+	virtual bool cached(const HeapFile* file, BlockID block_id) const;
+
+	/**
+	 * Cache a block that was read ahead of being asked for (left unpinned and unreferenced, so it
+	 * goes quickly if nobody does ask for it). Does nothing if the block is already cached.
+	 * @param file      file the block is in
+	 * @param block_id  which block
+	 * @param data      DbBlock::BLOCK_SZ bytes of block contents
+	 * @param ring      frames to recycle for a sequential scan (nullptr for normal access)
+	 */
+	virtual void prefetched(HeapFile* file, BlockID block_id, const void* data, BufferRing* ring=nullptr);
+
+	/**
+	 * Take a frame to read a block into asynchronously. The frame stays pinned, and is not yet
+	 * known as holding the block, until install() (or abandon()) is called once the read is done.
+	 * @param file      file the block is in
+	 * @param block_id  which block will be read into it
+	 * @param ring      frames to recycle for a sequential scan (nullptr for normal access)
+	 * @returns         pinned frame to read into
+	 */
+	virtual BufferFrame* claim(HeapFile* file, BlockID block_id, BufferRing* ring=nullptr);
+
+	/**
+	 * Cache the block just read into a claimed frame (unpinned and unreferenced, like prefetched()).
+	 * @param frame     frame from claim() now holding the block
+	 * @param file      file the block is in
+	 * @param block_id  which block
+	 */
+	virtual void install(BufferFrame* frame, HeapFile* file, BlockID block_id);
+
+	/**
+	 * Give back a claimed frame whose read failed.
+	 * @param frame  frame from claim()
+	 */
+	virtual void abandon(BufferFrame* frame);
+
+	/**
+	 * Release a pin.
+	 * @param frame  frame from pin() or pin_new()
+	 */
+	virtual void unpin(BufferFrame* frame);
+
+	/**
+	 * Note that the block in frame has changed and has to be written back.
+	 * @param frame  pinned frame
+	 */
+	virtual void mark_dirty(BufferFrame* frame);
+
+	/**
+	 * Write back all the dirty blocks of the given file.
+	 * @param file  the file
+	 */
+	virtual void flush(HeapFile* file);
+
+	/**
+	 * Write back every dirty block in the pool.
+	 */
+	virtual void flush_all();
+
+	/**
+	 * Forget all the cached blocks of the given file without writing them (e.g., when it is closed
+	 * or dropped). Frames still pinned are detached from the file and become free once unpinned.
+	 * @param file  the file
+	 */
+	virtual void release(HeapFile* file);
+
+	/**
+	 * The latch the pool's methods hold, for a file to hold around reads of its own that fill frames
+	 * (e.g., read_ahead) so they do not overlap pool misses or one another.
+	 */
+	std::recursive_mutex& latch() const {return latch_mutex;}
+
+protected:
+	typedef std::pair<const HeapFile*, BlockID> FrameKey;
+	struct FrameKeyHash {
+		size_t operator()(const FrameKey& key) const {
+			return std::hash<const void*>()(key.first) ^ (std::hash<BlockID>()(key.second) * 31);
+		}
+	};
+
+	uint nframes;
+	char* memory;
+	BufferFrame* frames;
+	uint hand;
+	std::unordered_map<FrameKey, uint, FrameKeyHash> table;
+	mutable std::recursive_mutex latch_mutex;
+
+	virtual BufferFrame* victim();
+	virtual BufferFrame* ring_victim(BufferRing* ring);
+	virtual void evict(BufferFrame* frame);
+	virtual void assign(BufferFrame* frame, HeapFile* file, BlockID block_id, BufferRing* ring);
+	virtual void write_back(BufferFrame* frame);
+};
@@ -0,0 +1,137 @@
+/**
+ * @file data_chunk.cpp - implementation of:
+ * DataChunk
+ */
+#include <string.h>
+#include "data_chunk.h"
+
+using namespace std;
+
+// Every vector is allocated up front at full capacity; a chunk is filled and reset over and over.
+DataChunk::DataChunk(const RowSchema& columns, const vector<ColumnAttribute::DataType>& types)
+		: schema(columns), vectors(types.size()), sel(CAPACITY), count(0), n_selected(0), blocks() {
+	if (columns->size() != types.size())
+		throw DbRelationError("chunk needs a type for each column");
+	for (uint j = 0; j < types.size(); j++) {
+		Vector& vector = this->vectors[j];
+		vector.type = types[j];
+		switch (types[j]) {
+			case ColumnAttribute::INT:
+				vector.ints.resize(CAPACITY);
+				break;
+			case ColumnAttribute::BOOLEAN:
+				vector.booleans.resize(CAPACITY);
+				break;
+			case ColumnAttribute::TEXT:
+				vector.texts.resize(CAPACITY);
+				break;
+		}
+		vector.valid.resize(CAPACITY);
+	}
+}
+
+void DataChunk::reset() {
+	this->count = 0;
+	this->n_selected = 0;
+	this->blocks.clear();
+}
+
+// New rows are appended selected, so while nothing has been dropped the selection is 0, 1, 2, ...
+uint DataChunk::append(uint n) {
+	if (n > room())
+		throw DbRelationError("chunk full");
+	uint first = this->count;
+	for (uint i = first; i < first + n; i++)
+		this->sel[this->n_selected++] = (u_int16_t)i;
+	this->count += n;
+	return first;
+}
+
+// A run of rows from the same block holds it once.
+void DataChunk::hold(const shared_ptr<DbBlock>& block) {
+	if (this->blocks.empty() || this->blocks.back() != block)
+		this->blocks.push_back(block);
+}
+
+// INT and BOOLEAN columns are compared all at once with a FilterKernels kernel (selected or not, since
+// that is cheaper than gathering the selected ones), then the selection is narrowed to the rows that
+// passed. TEXT is compared just for the selected rows.
+void DataChunk::select(uint column, FilterKernels::Op op, const Value& value, const Value& high) {
+	const Vector& vector = this->vectors[column];
+	if (value.data_type != vector.type) {
+		this->n_selected = 0;
+		return;
+	}
+	const uint8_t* valid = vector.valid.data();
+	uint kept = 0;
+	if (vector.type == ColumnAttribute::TEXT) {
+		if (op != FilterKernels::EQUAL)
+			throw DbRelationError("TEXT values can only be compared for equality");
+		for (uint k = 0; k < this->n_selected; k++) {
+			uint i = this->sel[k];
+			const TextView& text = vector.texts[i];
+			if (valid[i] && FilterKernels::text_equal(text.data, text.size, value.s.data(), (u_int16_t)value.s.length()))
+				this->sel[kept++] = (u_int16_t)i;
+		}
+		this->n_selected = kept;
+		return;
+	}
+
+	uint64_t bitmap[CAPACITY / 64];
+	memset(bitmap, 0xff, sizeof(bitmap));
+	if (vector.type == ColumnAttribute::INT)
+		FilterKernels::select_int(vector.ints.data(), this->count, op, value.n, high.n, bitmap);
+	else
+		FilterKernels::select_boolean(vector.booleans.data(), this->count, op, (uint8_t)value.n, (uint8_t)high.n,
+									  bitmap);
+	for (uint k = 0; k < this->n_selected; k++) {
+		uint i = this->sel[k];
+		if (valid[i] && ((bitmap[i / 64] >> (i % 64)) & 1))
+			this->sel[kept++] = (u_int16_t)i;
+	}
+	this->n_selected = kept;
+}
+
+Row* DataChunk::row(uint i, const vector<uint>& columns, const RowSchema& schema, Arena* arena) const {
+	RowSchema there = schema;
+	uint n = (uint)columns.size();
+	for (uint j = 0; j < n; j++)
+		if (!this->vectors[columns[j]].valid[i]) {
+			// row written before some of these columns were added to the table: leave them out
+			ColumnNames present;
+			for (uint k = 0; k < n; k++)
+				if (this->vectors[columns[k]].valid[i])
+					present.push_back((*schema)[k]);
+			there = make_shared<const ColumnNames>(present);
+			break;
+		}
+
+	Row* row = Row::create(there, arena);
+	uint k = 0;
+	for (uint j = 0; j < n; j++) {
+		const Vector& vector = this->vectors[columns[j]];
+		if (!vector.valid[i])
+			continue;
+		Value& value = (*row)[k++];
+		value.data_type = vector.type;
+		switch (vector.type) {
+			case ColumnAttribute::INT:
+				value.n = vector.ints[i];
+				break;
+			case ColumnAttribute::BOOLEAN:
+				value.n = vector.booleans[i];
+				break;
+			case ColumnAttribute::TEXT:
+				value.s.assign(vector.texts[i].data, vector.texts[i].size);
+				break;
+		}
+	}
+	return row;
+}
+
+int DataChunk::column(const Identifier& column_name) const {
+	for (uint j = 0; j < this->schema->size(); j++)
+		if ((*this->schema)[j] == column_name)
+			return (int)j;
+	return -1;
+}
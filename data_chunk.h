@@ -0,0 +1,127 @@
+/**
+ * @file data_chunk.h - a batch of rows held a column at a time
+ * TextView
+ * DataChunk
+ */
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "storage_engine.h"
+#include "filter_kernels.h"
+
+/**
+ * @class TextView - a TEXT value left where it is (in a record of a block the chunk holds)
+ */
+struct TextView {
+	const char* data;
+	u_int16_t size;
+};
+
+/**
+ * @class DataChunk - up to CAPACITY rows, a vector of values per column, for vectorized evaluation
+ *
+ * Each column is a vector of int32_t (INT), uint8_t (BOOLEAN), or TextView (TEXT) values, with a flag
+ * per row for whether the row has the column at all (a short INLINE record does not). A scan decodes
+ * records straight into the vectors, so a TEXT value is just a view into its block, and the chunk
+ * keeps the blocks it has views into until it is reset.
+ *
+ * The selection vector lists the rows still in, in order: a filter drops rows by shortening it,
+ * without moving any values. Row i of the chunk is the i-th row appended; the k-th row still in is
+ * row selection()[k].
+ */
+class DataChunk {
+public:
+	/**
+	 * Most rows a chunk holds.
+	 */
+	static const uint CAPACITY = 1024;
+
+	/**
+	 * @param columns  names of the columns
+	 * @param types    their types, in the same order
+	 */
+	DataChunk(const RowSchema& columns, const std::vector<ColumnAttribute::DataType>& types);
+	virtual ~DataChunk() {}
+	DataChunk(const DataChunk& other) = delete;
+	DataChunk(DataChunk&& temp) = delete;
+	DataChunk& operator=(const DataChunk& other) = delete;
+	DataChunk& operator=(DataChunk&& temp) = delete;
+
+	/**
+	 * Empty the chunk (letting go of its blocks), to be filled again.
+	 */
+	virtual void reset();
+
+	/**
+	 * Add rows to the end, all selected; the caller then fills in their values.
+	 * @param n  how many (no more than room())
+	 * @returns  the first one's index
+	 */
+	virtual uint append(uint n);
+
+	/**
+	 * Keep a block until the chunk is reset, for the TEXT views into it.
+	 */
+	virtual void hold(const std::shared_ptr<DbBlock>& block);
+
+	/**
+	 * Drop the selected rows whose value of a column fails a comparison (or that have no value for it).
+	 * @param column  the column's index in the chunk
+	 * @param op      comparison (TEXT columns can only be compared with EQUAL)
+	 * @param value   value compared against (of another type than the column's, nothing passes)
+	 * @param high    upper end, for BETWEEN
+	 */
+	virtual void select(uint column, FilterKernels::Op op, const Value& value, const Value& high=Value());
+
+	/**
+	 * Get some of the columns of a row.
+	 * @param i        the row's index
+	 * @param columns  the columns' indexes in the chunk
+	 * @param schema   the names the row gets for them
+	 * @param arena    where to build the row (nullptr for the heap)
+	 * @returns        the row (missing any column it has no value for, as RowLayout::decode does)
+	 */
+	virtual Row* row(uint i, const std::vector<uint>& columns, const RowSchema& schema, Arena* arena=nullptr) const;
+
+	/**
+	 * Find a column.
+	 * @param column_name  its name
+	 * @returns            its index in the chunk, or -1 if the chunk does not have it
+	 */
+	virtual int column(const Identifier& column_name) const;
+
+	uint size() const {return count;}
+	uint room() const {return CAPACITY - count;}
+	uint width() const {return (uint)vectors.size();}
+	uint selected() const {return n_selected;}
+	const u_int16_t* selection() const {return sel.data();}
+	const RowSchema& get_schema() const {return schema;}
+	ColumnAttribute::DataType get_type(uint column) const {return vectors[column].type;}
+
+	// a column's vectors, CAPACITY values long (only the one for its type is used)
+	int32_t* ints(uint column) {return vectors[column].ints.data();}
+	uint8_t* booleans(uint column) {return vectors[column].booleans.data();}
+	TextView* texts(uint column) {return vectors[column].texts.data();}
+	uint8_t* valid(uint column) {return vectors[column].valid.data();}
+	const int32_t* ints(uint column) const {return vectors[column].ints.data();}
+	const uint8_t* booleans(uint column) const {return vectors[column].booleans.data();}
+	const TextView* texts(uint column) const {return vectors[column].texts.data();}
+	const uint8_t* valid(uint column) const {return vectors[column].valid.data();}
+
+protected:
+	struct Vector {
+		ColumnAttribute::DataType type;
+		std::vector<int32_t> ints;
+		std::vector<uint8_t> booleans;
+		std::vector<TextView> texts;
+		std::vector<uint8_t> valid;    // 1 if the row has the column
+	};
+
+	RowSchema schema;
+	std::vector<Vector> vectors;
+	std::vector<u_int16_t> sel;        // selection vector: rows still in, in order
+	uint count;                        // rows appended
+	uint n_selected;                   // length of the selection vector
+	std::vector<std::shared_ptr<DbBlock>> blocks;  // what the TEXT views point into
+};
@@ -0,0 +1,366 @@
+/**
+ * @file direct_file.cpp - implementation of:
+ * IoQueue
+ * DirectFile
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "direct_file.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING
+#endif
+#endif
+
+using namespace std;
+
+
+/*
+ * *******************
+ * IoQueue class
+ * *******************
+ */
+
+IoQueue::IoQueue() : ring_fd(-1), entries(0), queued(0), submitted(0), sq_map(nullptr), sq_map_sz(0),
+		cq_map(nullptr), cq_map_sz(0), sqes(nullptr), sqes_sz(0), cqes(nullptr), sq_tail(nullptr),
+		sq_mask(nullptr), sq_array(nullptr), cq_head(nullptr), cq_tail(nullptr), cq_mask(nullptr) {
+}
+
+IoQueue::~IoQueue() {
+	close();
+}
+
+// Create the ring and map its submission queue, completion queue, and submission entries.
+bool IoQueue::open() {
+#ifdef HAVE_IO_URING
+	if (is_open())
+		return true;
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = (int)syscall(__NR_io_uring_setup, DEPTH, &params);
+	if (fd < 0)
+		return false;  // e.g., an old kernel, or forbidden by seccomp
+
+	this->sq_map_sz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	this->cq_map_sz = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap)
+		this->sq_map_sz = this->cq_map_sz = max(this->sq_map_sz, this->cq_map_sz);
+	this->sqes_sz = params.sq_entries * sizeof(io_uring_sqe);
+
+	void* sq = mmap(nullptr, this->sq_map_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	void* cq = single_mmap ? sq : mmap(nullptr, this->cq_map_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd,
+									   IORING_OFF_CQ_RING);
+	void* entries = mmap(nullptr, this->sqes_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || entries == MAP_FAILED) {
+		if (sq != MAP_FAILED)
+			munmap(sq, this->sq_map_sz);
+		if (cq != MAP_FAILED && !single_mmap)
+			munmap(cq, this->cq_map_sz);
+		if (entries != MAP_FAILED)
+			munmap(entries, this->sqes_sz);
+		::close(fd);
+		return false;
+	}
+
+	this->ring_fd = fd;
+	this->entries = params.sq_entries;
+	this->sq_map = sq;
+	this->cq_map = single_mmap ? nullptr : cq;
+	this->sqes = entries;
+	this->sq_tail = (unsigned*)((char*)sq + params.sq_off.tail);
+	this->sq_mask = (unsigned*)((char*)sq + params.sq_off.ring_mask);
+	this->sq_array = (unsigned*)((char*)sq + params.sq_off.array);
+	this->cq_head = (unsigned*)((char*)cq + params.cq_off.head);
+	this->cq_tail = (unsigned*)((char*)cq + params.cq_off.tail);
+	this->cq_mask = (unsigned*)((char*)cq + params.cq_off.ring_mask);
+	this->cqes = (char*)cq + params.cq_off.cqes;
+	this->queued = this->submitted = 0;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void IoQueue::close() {
+	if (!is_open())
+		return;
+	munmap(this->sqes, this->sqes_sz);
+	if (this->cq_map != nullptr)
+		munmap(this->cq_map, this->cq_map_sz);
+	munmap(this->sq_map, this->sq_map_sz);
+	::close(this->ring_fd);
+	this->ring_fd = -1;
+	this->sq_map = this->cq_map = this->sqes = this->cqes = nullptr;
+}
+
+// Fill in the next submission queue entry. At most entries requests are outstanding at once, so
+// the completion queue (twice as big) can never overflow.
+bool IoQueue::prepare(bool write, int fd, const char* buffer, uint32_t length, uint64_t offset, uint64_t tag) {
+#ifdef HAVE_IO_URING
+	if (this->queued + this->submitted >= this->entries)
+		return false;
+	unsigned tail = *this->sq_tail;
+	unsigned index = tail & *this->sq_mask;
+	io_uring_sqe* sqe = (io_uring_sqe*)this->sqes + index;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)buffer;
+	sqe->len = length;
+	sqe->off = offset;
+	sqe->user_data = tag;
+	this->sq_array[index] = index;
+	__atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	this->queued++;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void IoQueue::submit(uint wait_for) {
+#ifdef HAVE_IO_URING
+	while (this->queued > 0 || wait_for > 0) {
+		int done = (int)syscall(__NR_io_uring_enter, this->ring_fd, this->queued, wait_for,
+								wait_for > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+		if (done < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			throw DbRelationError(string("io_uring_enter failed: ") + strerror(errno));
+		}
+		this->queued -= (uint)done;
+		this->submitted += (uint)done;
+		if (this->queued == 0)
+			break;
+	}
+#endif
+}
+
+bool IoQueue::reap(uint64_t& tag, int& result) {
+#ifdef HAVE_IO_URING
+	unsigned head = *this->cq_head;
+	if (head == __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE))
+		return false;
+	io_uring_cqe* cqe = (io_uring_cqe*)this->cqes + (head & *this->cq_mask);
+	tag = cqe->user_data;
+	result = cqe->res;
+	__atomic_store_n(this->cq_head, head + 1, __ATOMIC_RELEASE);
+	this->submitted--;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+/*
+ * *******************
+ * DirectFile class
+ * *******************
+ */
+
+DirectFile::DirectFile(string name) : HeapFile(name), path(environment_path(name + ".blk")), fd(-1), io(), reading() {
+}
+
+// Close here rather than leaving it to ~HeapFile, which could only write back through Berkeley DB.
+DirectFile::~DirectFile() {
+	close();
+}
+
+// Delete the physical file.
+void DirectFile::drop(void) {
+	finish_reads();
+	BufferPool::pool().release(this);  // no point writing back blocks of a file being removed
+	close();
+	unlink(this->path.c_str());
+	this->fsm.drop();
+}
+
+// Write back the cached blocks and close the file.
+void DirectFile::close(void) {
+	if (!this->closed) {
+		finish_reads();
+		BufferPool::pool().flush(this);
+	}
+	BufferPool::pool().release(this);
+	this->fsm.close();
+	this->io.close();
+	if (this->fd >= 0)
+		::close(this->fd);
+	this->fd = -1;
+	this->closed = true;
+}
+
+// Get a block, first waiting for it if it is one of the blocks being read ahead.
+SlottedPage* DirectFile::get(BlockID block_id, BufferRing* ring) {
+	{
+		lock_guard<recursive_mutex> guard(BufferPool::pool().latch());  // the ring and reading are shared by scans
+		if (this->reading.find(block_id) != this->reading.end())
+			finish_reads();
+	}
+	return HeapFile::get(block_id, ring);
+}
+
+// Start reading the uncached blocks of [start, start + count) into claimed buffer pool frames and
+// return without waiting (after picking up the previous read-ahead, if still outstanding).
+void DirectFile::read_ahead(BlockID start, uint count, BufferRing* ring) {
+	BufferPool& pool = BufferPool::pool();
+	lock_guard<recursive_mutex> guard(pool.latch());
+	finish_reads();
+	BlockID stop = min(start + count, this->last + 1);
+	for (BlockID block_id = start; block_id < stop; block_id++) {
+		if (pool.cached(this, block_id))
+			continue;
+		BufferFrame* frame = pool.claim(this, block_id, ring);
+		if (this->io.is_open()) {
+			if (!this->io.prepare(false, this->fd, frame->data, DbBlock::BLOCK_SZ, offset(block_id), block_id)) {
+				pool.abandon(frame);
+				break;  // queue is full; the rest are read when asked for
+			}
+			this->reading[block_id] = frame;
+		} else if (pread(this->fd, frame->data, DbBlock::BLOCK_SZ, (off_t)offset(block_id)) == DbBlock::BLOCK_SZ) {
+			pool.install(frame, this, block_id);
+		} else {
+			pool.abandon(frame);
+		}
+	}
+	this->io.submit();
+}
+
+// Write the blocks after the high-water mark 1MB at a time, through an aligned buffer (the images
+// themselves need not be block-aligned, as O_DIRECT wants).
+BlockID DirectFile::append_blocks(const vector<char*>& blocks) {
+	const uint batch = 256;
+	BlockID first = this->last + 1;
+	void* staging = nullptr;
+	if (posix_memalign(&staging, DbBlock::BLOCK_SZ, (size_t)batch * DbBlock::BLOCK_SZ) != 0)
+		throw DbRelationError("cannot append to " + this->path);
+	for (size_t done = 0; done < blocks.size(); done += batch) {
+		size_t n = min(blocks.size() - done, (size_t)batch);
+		for (size_t i = 0; i < n; i++)
+			memcpy((char*)staging + i * DbBlock::BLOCK_SZ, blocks[done + i], DbBlock::BLOCK_SZ);
+		size_t sz = n * DbBlock::BLOCK_SZ;
+		if (pwrite(this->fd, staging, sz, (off_t)offset(first + done)) != (ssize_t)sz) {
+			free(staging);
+			throw DbRelationError("cannot append to " + this->path);
+		}
+	}
+	free(staging);
+	appended(first, blocks);
+	return first;
+}
+
+// Wait for all the outstanding read-ahead blocks and put them in the buffer pool.
+void DirectFile::finish_reads() {
+	BufferPool& pool = BufferPool::pool();
+	while (!this->reading.empty()) {
+		uint64_t tag;
+		int result;
+		while (!this->io.reap(tag, result))
+			this->io.submit(1);
+		auto found = this->reading.find((BlockID)tag);
+		if (found == this->reading.end())
+			continue;
+		if (result == (int)DbBlock::BLOCK_SZ)
+			pool.install(found->second, this, found->first);
+		else
+			pool.abandon(found->second);  // get() will try it again synchronously
+		this->reading.erase(found);
+	}
+}
+
+// Open (or create) the block file, with O_DIRECT if the file system allows it, and set up the ring.
+void DirectFile::db_open(uint flags) {
+	if (!this->closed)
+		return;
+	int open_flags = O_RDWR;
+	if (flags & DB_CREATE)
+		open_flags |= O_CREAT;
+	if (flags & DB_EXCL)
+		open_flags |= O_EXCL;
+	this->fd = ::open(this->path.c_str(), open_flags|O_DIRECT, 0644);
+	if (this->fd < 0 && errno == EINVAL)  // e.g., tmpfs (which creates the file before refusing O_DIRECT)
+		this->fd = ::open(this->path.c_str(), open_flags & ~O_EXCL, 0644);
+	if (this->fd < 0)
+		throw DbRelationError("cannot open " + this->path + ": " + strerror(errno));
+	struct stat st;
+	if (fstat(this->fd, &st) < 0) {
+		string error = strerror(errno);
+		::close(this->fd);
+		throw DbRelationError("cannot stat " + this->path + ": " + error);
+	}
+	this->allocated = (uint32_t)(st.st_size / DbBlock::BLOCK_SZ);
+	this->last = this->allocated;
+	this->io.open();
+	this->closed = false;
+}
+
+// Grow the file by EXTENT empty blocks with a single write.
+void DirectFile::extend() {
+	size_t extent_sz = (size_t)EXTENT * DbBlock::BLOCK_SZ;
+	void* extent = nullptr;
+	if (posix_memalign(&extent, DbBlock::BLOCK_SZ, extent_sz) != 0)
+		throw DbRelationError("cannot extend " + this->path);
+	memset(extent, 0, extent_sz);
+	for (uint i = 0; i < EXTENT; i++) {
+		Dbt data((char*)extent + (size_t)i * DbBlock::BLOCK_SZ, DbBlock::BLOCK_SZ);
+		SlottedPage format(data, this->allocated + 1 + i, true);
+	}
+	ssize_t written = pwrite(this->fd, extent, extent_sz, (off_t)offset(this->allocated + 1));
+	free(extent);
+	if (written != (ssize_t)extent_sz)
+		throw DbRelationError("cannot extend " + this->path);
+	this->allocated += EXTENT;
+	this->fsm.write_high_water(this->allocated);
+}
+
+// Read one block synchronously (buffer is a block-aligned buffer pool frame).
+void DirectFile::read_block(BlockID block_id, char* buffer) {
+	if (pread(this->fd, buffer, DbBlock::BLOCK_SZ, (off_t)offset(block_id)) != DbBlock::BLOCK_SZ)
+		throw DbRelationError("cannot read block " + to_string(block_id) + " of " + this->path);
+}
+
+// Write one block synchronously (e.g., evicted from the buffer pool).
+void DirectFile::write_block(BlockID block_id, const char* buffer) {
+	if (pwrite(this->fd, buffer, DbBlock::BLOCK_SZ, (off_t)offset(block_id)) != DbBlock::BLOCK_SZ)
+		throw DbRelationError("cannot write block " + to_string(block_id) + " of " + this->path);
+}
+
+// Write a batch of blocks, keeping up to a queue's worth in flight at once.
+void DirectFile::write_blocks(const vector<BufferFrame*>& frames) {
+	if (!this->io.is_open()) {
+		HeapFile::write_blocks(frames);
+		return;
+	}
+	finish_reads();  // so that every completion reaped here is one of these writes
+	bool failed = false;
+	for (auto const& frame: frames) {
+		while (!this->io.prepare(true, this->fd, frame->data, DbBlock::BLOCK_SZ, offset(frame->block_id),
+								 frame->block_id)) {
+			uint64_t tag;
+			int result;
+			this->io.submit(1);
+			while (this->io.reap(tag, result))
+				failed = failed || result != (int)DbBlock::BLOCK_SZ;
+		}
+	}
+	this->io.submit();
+	while (this->io.in_flight() > 0) {
+		uint64_t tag;
+		int result;
+		while (!this->io.reap(tag, result))
+			this->io.submit(1);
+		failed = failed || result != (int)DbBlock::BLOCK_SZ;
+	}
+	if (failed)
+		throw DbRelationError("cannot write back blocks of " + this->path);
+}
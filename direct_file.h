@@ -0,0 +1,131 @@
+/**
+ * @file direct_file.h - heap file doing its own O_DIRECT block I/O, in batches through io_uring
+ * IoQueue
+ * DirectFile: HeapFile
+ */
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "heap_storage.h"
+
+/**
+ * @class IoQueue - a Linux io_uring, set up with the raw system calls
+ *
+ * Block reads and writes are queued with prepare(), handed to the kernel together with submit(),
+ * and picked up as they complete with reap(). If the kernel (or the build) has no io_uring, open()
+ * returns false and the caller does its I/O synchronously instead.
+ */
+class IoQueue {
+public:
+	/**
+	 * Most requests the queue holds at once.
+	 */
+	static const uint DEPTH = 64;
+
+	IoQueue();
+	virtual ~IoQueue();
+	IoQueue(const IoQueue& other) = delete;
+	IoQueue(IoQueue&& temp) = delete;
+	IoQueue& operator=(const IoQueue& other) = delete;
+	IoQueue& operator=(IoQueue&& temp) = delete;
+
+	/**
+	 * Set up the ring.
+	 * @returns  false if io_uring is not available
+	 */
+	virtual bool open();
+	virtual void close();
+	virtual bool is_open() const {return ring_fd >= 0;}
+
+	/**
+	 * Queue a read or write (not started until submit()).
+	 * @param write   true for a write, false for a read
+	 * @param fd      file to read or write
+	 * @param buffer  memory to read into or write from (aligned for O_DIRECT)
+	 * @param length  number of bytes
+	 * @param offset  position in the file
+	 * @param tag     handed back by reap() when the request completes
+	 * @returns       false if the queue is full (submit and reap some first)
+	 */
+	virtual bool prepare(bool write, int fd, const char* buffer, uint32_t length, uint64_t offset, uint64_t tag);
+
+	/**
+	 * Start all the queued requests.
+	 * @param wait_for  number of completions to wait for before returning (0 to not wait)
+	 */
+	virtual void submit(uint wait_for=0);
+
+	/**
+	 * Pick up a completed request, if there is one.
+	 * @param tag     returned by reference: tag of the request
+	 * @param result  returned by reference: bytes transferred, or -errno
+	 * @returns       false if nothing has completed
+	 */
+	virtual bool reap(uint64_t& tag, int& result);
+
+	/**
+	 * Number of requests submitted but not reaped.
+	 */
+	virtual uint in_flight() const {return submitted;}
+
+protected:
+	int ring_fd;
+	uint entries;
+	uint queued;     // prepared but not yet submitted
+	uint submitted;  // submitted but not yet reaped
+	void* sq_map;
+	size_t sq_map_sz;
+	void* cq_map;
+	size_t cq_map_sz;
+	void* sqes;
+	size_t sqes_sz;
+	void* cqes;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+};
+
+/**
+ * @class DirectFile - heap file in a plain file of 4kB blocks opened with O_DIRECT
+ *
+ * Block n is at offset (n - 1) * BLOCK_SZ of <name>.blk in the database environment's directory.
+ * Blocks are cached in the BufferPool (whose frames are block-aligned, as O_DIRECT needs) exactly as
+ * for HeapFile, but the I/O bypasses Berkeley DB and the kernel's page cache. Write-backs of a
+ * flush go out as one batch. read_ahead() submits its reads and returns without waiting, so a scan
+ * works on one window of blocks while the next is being read; get() waits only if its own block is
+ * still on the way.
+ */
+class DirectFile : public HeapFile {
+public:
+	DirectFile(std::string name);
+	virtual ~DirectFile();
+	DirectFile(const DirectFile& other) = delete;
+	DirectFile(DirectFile&& temp) = delete;
+	DirectFile& operator=(const DirectFile& other) = delete;
+	DirectFile& operator=(DirectFile&& temp) = delete;
+
+	virtual void drop(void);
+	virtual void close(void);
+	using HeapFile::get;
+	virtual SlottedPage* get(BlockID block_id, BufferRing* ring);
+	virtual void read_ahead(BlockID start, uint count, BufferRing* ring=nullptr);
+	virtual BlockID append_blocks(const std::vector<char*>& blocks);
+
+protected:
+	std::string path;
+	int fd;
+	IoQueue io;
+	std::unordered_map<BlockID, BufferFrame*> reading;  // read_ahead blocks not yet reaped
+
+	virtual void db_open(uint flags=0);
+	virtual void extend();
+	virtual void read_block(BlockID block_id, char* buffer);
+	virtual void write_block(BlockID block_id, const char* buffer);
+	virtual void write_blocks(const std::vector<BufferFrame*>& frames);
+	virtual void finish_reads();
+	virtual uint64_t offset(BlockID block_id) const {return (uint64_t)(block_id - 1) * DbBlock::BLOCK_SZ;}
+};
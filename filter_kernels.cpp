@@ -0,0 +1,305 @@
+/**
+ * @file filter_kernels.cpp - implementation of:
+ * FilterKernels
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "filter_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+using namespace std;
+
+static atomic<int> current_level(-1);  // -1 until chosen
+
+// The best the CPU can do.
+static FilterKernels::Level supported_level() {
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return FilterKernels::AVX2;
+	if (__builtin_cpu_supports("sse4.2"))
+		return FilterKernels::SSE4;
+#endif
+	return FilterKernels::SCALAR;
+}
+
+FilterKernels::Level FilterKernels::level() {
+	int chosen = current_level.load(memory_order_relaxed);
+	if (chosen < 0) {
+		chosen = supported_level();
+		current_level.store(chosen, memory_order_relaxed);
+	}
+	return (Level)chosen;
+}
+
+void FilterKernels::set_level(Level level) {
+	Level best = supported_level();
+	current_level.store(level < best ? level : best, memory_order_relaxed);
+}
+
+// Values from i on, one at a time (all of them, or the tail the vector loop did not get to).
+template<typename T>
+static void select_scalar(const T* values, uint i, uint n, FilterKernels::Op op, T a, T b, uint64_t* bitmap) {
+	for (; i < n; i++)
+		if (!FilterKernels::passes(values[i], op, a, b))
+			bitmap[i / 64] &= ~((uint64_t)1 << (i % 64));
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// Clear the bits of the lanes (starting at value i) that failed; passed has a bit per lane.
+static inline void clear_failed(uint64_t* bitmap, uint i, uint64_t passed, uint lanes) {
+	uint64_t lane_mask = lanes == 64 ? ~(uint64_t)0 : (((uint64_t)1 << lanes) - 1);
+	bitmap[i / 64] &= ~((~passed & lane_mask) << (i % 64));
+}
+
+__attribute__((target("avx2")))
+static void select_int_avx2(const int32_t* values, uint n, FilterKernels::Op op, int32_t a, int32_t b,
+							uint64_t* bitmap) {
+	__m256i va = _mm256_set1_epi32(a);
+	__m256i vb = _mm256_set1_epi32(b);
+	uint i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+		__m256i pass;
+		switch (op) {
+			case FilterKernels::EQUAL:
+				pass = _mm256_cmpeq_epi32(v, va);
+				break;
+			case FilterKernels::LESS:
+				pass = _mm256_cmpgt_epi32(va, v);
+				break;
+			case FilterKernels::GREATER:
+				pass = _mm256_cmpgt_epi32(v, va);
+				break;
+			case FilterKernels::BETWEEN:
+			default:
+				pass = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi32(va, v), _mm256_cmpgt_epi32(v, vb)),
+										   _mm256_set1_epi32(-1));
+				break;
+		}
+		clear_failed(bitmap, i, (uint64_t)(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(pass)), 8);
+	}
+	select_scalar(values, i, n, op, a, b, bitmap);
+}
+
+__attribute__((target("sse4.2")))
+static void select_int_sse4(const int32_t* values, uint n, FilterKernels::Op op, int32_t a, int32_t b,
+							uint64_t* bitmap) {
+	__m128i va = _mm_set1_epi32(a);
+	__m128i vb = _mm_set1_epi32(b);
+	uint i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+		__m128i pass;
+		switch (op) {
+			case FilterKernels::EQUAL:
+				pass = _mm_cmpeq_epi32(v, va);
+				break;
+			case FilterKernels::LESS:
+				pass = _mm_cmplt_epi32(v, va);
+				break;
+			case FilterKernels::GREATER:
+				pass = _mm_cmpgt_epi32(v, va);
+				break;
+			case FilterKernels::BETWEEN:
+			default:
+				pass = _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi32(v, va), _mm_cmpgt_epi32(v, vb)),
+										_mm_set1_epi32(-1));
+				break;
+		}
+		clear_failed(bitmap, i, (uint64_t)(uint32_t)_mm_movemask_ps(_mm_castsi128_ps(pass)), 4);
+	}
+	select_scalar(values, i, n, op, a, b, bitmap);
+}
+
+// BOOLEANs are 0 or 1, so the signed byte compares are fine.
+__attribute__((target("avx2")))
+static void select_boolean_avx2(const uint8_t* values, uint n, FilterKernels::Op op, uint8_t a, uint8_t b,
+								uint64_t* bitmap) {
+	__m256i va = _mm256_set1_epi8((char)a);
+	__m256i vb = _mm256_set1_epi8((char)b);
+	uint i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+		__m256i pass;
+		switch (op) {
+			case FilterKernels::EQUAL:
+				pass = _mm256_cmpeq_epi8(v, va);
+				break;
+			case FilterKernels::LESS:
+				pass = _mm256_cmpgt_epi8(va, v);
+				break;
+			case FilterKernels::GREATER:
+				pass = _mm256_cmpgt_epi8(v, va);
+				break;
+			case FilterKernels::BETWEEN:
+			default:
+				pass = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi8(va, v), _mm256_cmpgt_epi8(v, vb)),
+										   _mm256_set1_epi8(-1));
+				break;
+		}
+		clear_failed(bitmap, i, (uint64_t)(uint32_t)_mm256_movemask_epi8(pass), 32);
+	}
+	select_scalar(values, i, n, op, a, b, bitmap);
+}
+
+__attribute__((target("sse4.2")))
+static void select_boolean_sse4(const uint8_t* values, uint n, FilterKernels::Op op, uint8_t a, uint8_t b,
+								uint64_t* bitmap) {
+	__m128i va = _mm_set1_epi8((char)a);
+	__m128i vb = _mm_set1_epi8((char)b);
+	uint i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+		__m128i pass;
+		switch (op) {
+			case FilterKernels::EQUAL:
+				pass = _mm_cmpeq_epi8(v, va);
+				break;
+			case FilterKernels::LESS:
+				pass = _mm_cmplt_epi8(v, va);
+				break;
+			case FilterKernels::GREATER:
+				pass = _mm_cmpgt_epi8(v, va);
+				break;
+			case FilterKernels::BETWEEN:
+			default:
+				pass = _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi8(v, va), _mm_cmpgt_epi8(v, vb)),
+										_mm_set1_epi8(-1));
+				break;
+		}
+		clear_failed(bitmap, i, (uint64_t)(uint32_t)_mm_movemask_epi8(pass), 16);
+	}
+	select_scalar(values, i, n, op, a, b, bitmap);
+}
+
+// Equal bytes, 32 at a time, then the rest.
+__attribute__((target("avx2")))
+static bool bytes_equal_avx2(const char* s, const char* t, uint n) {
+	uint i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i diff = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(s + i)),
+										_mm256_loadu_si256((const __m256i*)(t + i)));
+		if (!_mm256_testz_si256(diff, diff))
+			return false;
+	}
+	return memcmp(s + i, t + i, n - i) == 0;
+}
+
+__attribute__((target("sse4.2")))
+static bool bytes_equal_sse4(const char* s, const char* t, uint n) {
+	uint i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i diff = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(s + i)), _mm_loadu_si128((const __m128i*)(t + i)));
+		if (!_mm_testz_si128(diff, diff))
+			return false;
+	}
+	return memcmp(s + i, t + i, n - i) == 0;
+}
+
+#endif  // HAVE_X86_KERNELS
+
+void FilterKernels::select_int(const int32_t* values, uint n, Op op, int32_t a, int32_t b, uint64_t* bitmap) {
+#ifdef HAVE_X86_KERNELS
+	switch (level()) {
+		case AVX2:
+			select_int_avx2(values, n, op, a, b, bitmap);
+			return;
+		case SSE4:
+			select_int_sse4(values, n, op, a, b, bitmap);
+			return;
+		default:
+			break;
+	}
+#endif
+	select_scalar(values, 0, n, op, a, b, bitmap);
+}
+
+void FilterKernels::select_boolean(const uint8_t* values, uint n, Op op, uint8_t a, uint8_t b, uint64_t* bitmap) {
+#ifdef HAVE_X86_KERNELS
+	switch (level()) {
+		case AVX2:
+			select_boolean_avx2(values, n, op, a, b, bitmap);
+			return;
+		case SSE4:
+			select_boolean_sse4(values, n, op, a, b, bitmap);
+			return;
+		default:
+			break;
+	}
+#endif
+	select_scalar(values, 0, n, op, a, b, bitmap);
+}
+
+// Different lengths never match, so only same-length values get their bytes compared.
+bool FilterKernels::text_equal(const char* s, uint16_t s_len, const char* t, uint16_t t_len) {
+	if (s_len != t_len)
+		return false;
+	return text_prefix(s, s_len, t, t_len);
+}
+
+bool FilterKernels::text_prefix(const char* s, uint16_t s_len, const char* prefix, uint16_t prefix_len) {
+	if (prefix_len > s_len)
+		return false;
+#ifdef HAVE_X86_KERNELS
+	switch (level()) {
+		case AVX2:
+			return bytes_equal_avx2(s, prefix, prefix_len);
+		case SSE4:
+			return bytes_equal_sse4(s, prefix, prefix_len);
+		default:
+			break;
+	}
+#endif
+	return memcmp(s, prefix, prefix_len) == 0;
+}
+
+
+// test function -- returns true if all tests pass
+bool test_filter_kernels() {
+	typedef FilterKernels FK;
+	const uint n = 1000;  // not a multiple of any vector width, so the tails get used too
+	vector<int32_t> ints(n);
+	vector<uint8_t> booleans(n);
+	for (uint i = 0; i < n; i++) {
+		ints[i] = (int32_t)(rand() % 200) - 100;
+		booleans[i] = (uint8_t)(rand() % 2);
+	}
+	string long_text(100, 'x');
+	string other_text = long_text;
+	other_text[70] = 'y';
+
+	FK::Level best = FK::level();
+	bool ok = true;
+	for (int lvl = FK::SCALAR; lvl <= best; lvl++) {
+		FK::set_level((FK::Level)lvl);
+		for (int op = FK::EQUAL; op <= FK::BETWEEN; op++) {
+			vector<uint64_t> int_bitmap((n + 63) / 64, ~(uint64_t)0);
+			vector<uint64_t> boolean_bitmap((n + 63) / 64, ~(uint64_t)0);
+			FK::select_int(ints.data(), n, (FK::Op)op, -10, 20, int_bitmap.data());
+			FK::select_boolean(booleans.data(), n, (FK::Op)op, 1, 1, boolean_bitmap.data());
+			for (uint i = 0; i < n; i++) {
+				ok = ok && ((int_bitmap[i / 64] >> (i % 64)) & 1) == FK::passes<int32_t>(ints[i], (FK::Op)op, -10, 20);
+				ok = ok && ((boolean_bitmap[i / 64] >> (i % 64)) & 1) == FK::passes<uint8_t>(booleans[i], (FK::Op)op, 1, 1);
+			}
+		}
+		ok = ok && FK::text_equal(long_text.data(), 100, long_text.data(), 100)
+			 && !FK::text_equal(long_text.data(), 100, other_text.data(), 100)
+			 && !FK::text_equal(long_text.data(), 100, long_text.data(), 99)
+			 && FK::text_prefix(other_text.data(), 100, long_text.data(), 70)
+			 && !FK::text_prefix(other_text.data(), 100, long_text.data(), 71);
+		if (!ok)
+			cout << "filter kernels failed at level " << lvl << endl;
+	}
+	FK::set_level(best);
+	return ok;
+}
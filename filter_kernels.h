@@ -0,0 +1,104 @@
+/**
+ * @file filter_kernels.h - predicate kernels over batches of column values
+ * FilterKernels
+ */
+#pragma once
+
+#include <cstdint>
+#include <sys/types.h>
+
+/**
+ * @class FilterKernels - compare a batch of one column's values against a constant, into a bitmap
+ *
+ * The INT and BOOLEAN kernels take the values of one column from a run of records (a page's worth,
+ * say) and clear the bit of each record whose value fails the comparison, so running one kernel per
+ * term of a conjunction over the same bitmap leaves set just the records that pass them all. Bit i
+ * of the bitmap is bit (i % 64) of word i / 64.
+ *
+ * Each kernel has an AVX2, an SSE4.2, and a plain version. The best one the CPU supports is picked
+ * the first time a kernel is used (from cpuid); set_level() forces a lower one (e.g., for testing).
+ */
+class FilterKernels {
+public:
+	enum Op {
+		EQUAL,    // value == a
+		LESS,     // value < a
+		GREATER,  // value > a
+		BETWEEN   // a <= value <= b
+	};
+
+	enum Level {
+		SCALAR,
+		SSE4,
+		AVX2
+	};
+
+	/**
+	 * Instruction set the kernels are using.
+	 */
+	static Level level();
+
+	/**
+	 * Use a given instruction set from now on (no higher than the CPU supports).
+	 * @param level  SCALAR, SSE4, or AVX2
+	 */
+	static void set_level(Level level);
+
+	/**
+	 * Does one value pass the comparison? (What each kernel works out for every value in its batch,
+	 * for a caller checking a single value.)
+	 * @param value  the value
+	 * @param op     comparison
+	 * @param a      value compared against
+	 * @param b      upper end for BETWEEN
+	 * @returns      true if it passes
+	 */
+	template<typename T>
+	static inline bool passes(T value, Op op, T a, T b) {
+		switch (op) {
+			case EQUAL:
+				return value == a;
+			case LESS:
+				return value < a;
+			case GREATER:
+				return value > a;
+			case BETWEEN:
+			default:
+				return a <= value && value <= b;
+		}
+	}
+
+	/**
+	 * Clear the bits of the INT values failing the comparison.
+	 * @param values  the values
+	 * @param n       how many
+	 * @param op      comparison
+	 * @param a       value compared against
+	 * @param b       upper end for BETWEEN
+	 * @param bitmap  (n + 63) / 64 words, bits left set for the values that pass
+	 */
+	static void select_int(const int32_t* values, uint n, Op op, int32_t a, int32_t b, uint64_t* bitmap);
+
+	/**
+	 * Clear the bits of the BOOLEAN values (0 or 1, a byte each) failing the comparison.
+	 * @param values  the values
+	 * @param n       how many
+	 * @param op      comparison
+	 * @param a       value compared against
+	 * @param b       upper end for BETWEEN
+	 * @param bitmap  (n + 63) / 64 words, bits left set for the values that pass
+	 */
+	static void select_boolean(const uint8_t* values, uint n, Op op, uint8_t a, uint8_t b, uint64_t* bitmap);
+
+	/**
+	 * Are two TEXT values the same (lengths first, then the bytes a vector at a time)?
+	 */
+	static bool text_equal(const char* s, uint16_t s_len, const char* t, uint16_t t_len);
+
+	/**
+	 * Does a TEXT value start with the given prefix?
+	 */
+	static bool text_prefix(const char* s, uint16_t s_len, const char* prefix, uint16_t prefix_len);
+};
+
+bool test_filter_kernels();
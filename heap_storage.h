@@ -11,6 +11,9 @@
 
 #include "db_cxx.h"
 #include "storage_engine.h"
+#include "buffer_pool.h"
+#include "filter_kernels.h"
+#include "data_chunk.h"
 
 /**
  * @class SlottedPage - heap file implementation of DbBlock.
@@ -22,17 +25,26 @@
         Each record has a header which is a fixed offset from the beginning of the block:
             Bytes 0x00 - Ox01: number of records
             Bytes 0x02 - 0x03: offset to end of free space
-            Bytes 0x04 - 0x05: size of record 1
-            Bytes 0x06 - 0x07: offset to record 1
+            Bytes 0x04 - 0x05: number of dead bytes (from deleted or shrunk records)
+            Bytes 0x06 - 0x07: unused
+            Bytes 0x08 - 0x09: size of record 1
+            Bytes 0x0A - 0x0B: offset to record 1
             etc.
+
+        Deletes and updates leave the old bytes where they are and just count them as dead.
+        The live records are compacted in one pass only when an add or put needs the room.
+
+        A page handed out by HeapFile lives in a BufferPool frame, which stays pinned until
+        the page is deleted.
  *
  */
 class SlottedPage : public DbBlock {
+	friend class HeapFile;
 public:
 	SlottedPage(Dbt &block, BlockID block_id, bool is_new=false);
 	// Big 5 - we only need the destructor, copy-ctor, move-ctor, and op= are unnecessary
 	// but we delete them explicitly just to make sure we don't use them accidentally
-	virtual ~SlottedPage() {}
+	virtual ~SlottedPage();
 	SlottedPage(const SlottedPage& other) = delete;
 	SlottedPage(SlottedPage&& temp) = delete;
 	SlottedPage& operator=(const SlottedPage& other) = delete;
@@ -43,34 +55,136 @@ public:
 	virtual void put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError);
 	virtual void del(RecordID record_id);
 	virtual RecordIDs* ids(void) const;
+
+	/**
+	 * Look at a record where it is in the block, without copying it.
+	 * @param record_id  which record
+	 * @param size       returned by reference: its size
+	 * @returns          its bytes (good until the block changes), or nullptr if it has been deleted
+	 */
+	virtual const char* peek(RecordID record_id, u_int16_t& size) const;
+	virtual RecordID next_id(RecordID record_id) const;
 	virtual void clear();
 	virtual u_int16_t size() const;
+	virtual u_int16_t free_space() const;
 
 protected:
 	uint16_t num_records;
 	uint16_t end_free;
+	uint16_t dead;
+	BufferFrame* frame;  // buffer pool frame holding this block (nullptr if not from the pool)
 
 	virtual void get_header(uint16_t &size, uint16_t &loc, RecordID id=0) const;
 	virtual void put_header(RecordID id=0, uint16_t size=0, uint16_t loc=0);
 	virtual bool has_room(uint16_t size) const;
-	virtual void slide(uint16_t start, uint16_t end);
+	virtual uint16_t contiguous_space() const;
+	virtual void compact();
 	virtual uint16_t get_n(uint16_t offset) const;
 	virtual void put_n(uint16_t offset, uint16_t n);
 	virtual void* address(uint16_t offset) const;
 };
 
+/**
+ * @class FreeSpaceMap - persistent record of how much room each block of a HeapFile has left
+ *
+ * Kept in its own Berkeley DB RecNo file alongside the heap file. Record 1 is a header; each
+ * following record is a map page with one byte per block of the heap file (block_id 0 is unused)
+ * holding the block's free space in units of GRANULE bytes.
+ *
+ * The map is only a hint. Decreases in free space are written out lazily (on close), since a block
+ * that claims more room than it has is just corrected when an add to it fails. Increases (from
+ * deletes) are written through so that the space is not forgotten.
+ *
+ * The header also keeps the heap file's high-water mark: the number of blocks actually handed out,
+ * since the file itself is grown an extent at a time.
+ */
+class FreeSpaceMap {
+public:
+	static const uint GRANULE = 32;
+	static const uint32_t MAGIC = 0x4d534631;  // "FSM1"
+
+	FreeSpaceMap(std::string name);
+	virtual ~FreeSpaceMap() {}
+	FreeSpaceMap(const FreeSpaceMap& other) = delete;
+	FreeSpaceMap(FreeSpaceMap&& temp) = delete;
+	FreeSpaceMap& operator=(const FreeSpaceMap& other) = delete;
+	FreeSpaceMap& operator=(FreeSpaceMap&& temp) = delete;
+
+	virtual void create(void);
+	virtual void drop(void);
+	virtual void open(void);
+	virtual void close(void);
+
+	/**
+	 * Write out any lazily-kept changes, leaving the map open.
+	 */
+	virtual void flush(void);
+
+	/**
+	 * Find a block that should have room for a record of the given size.
+	 * @param size  size of the record's data
+	 * @returns     block id, or 0 if no block is known to have enough room
+	 */
+	virtual BlockID find(uint16_t size);
+
+	/**
+	 * Record the current free space of a block.
+	 * @param block_id    which block
+	 * @param free_bytes  free space of the block (as from DbBlock::free_space())
+	 */
+	virtual void update(BlockID block_id, uint16_t free_bytes);
+
+	/**
+	 * Get the heap file's high-water mark as of when it was last closed.
+	 * @returns  last block id handed out, or 0 if not known (map written before there were extents)
+	 */
+	virtual BlockID get_high_water() const {return high_water;}
+
+	/**
+	 * Record a new high-water mark (written out on close).
+	 * @param block_id  last block id handed out
+	 */
+	virtual void set_high_water(BlockID block_id);
+
+	/**
+	 * Write a high-water mark to the header right away. The heap file uses this to store the end
+	 * of each new extent, so after an unclean shutdown it comes back with (at worst) a few extra
+	 * empty blocks rather than missing some.
+	 * @param block_id  block id to store
+	 */
+	virtual void write_high_water(BlockID block_id);
+
+protected:
+	std::string dbfilename;
+	bool closed;
+	Db db;
+	BlockID high_water;
+	bool header_dirty;
+	std::vector<uint8_t> categories;  // indexed by block id
+	std::vector<bool> dirty;          // indexed by map page
+	BlockID search_from;              // no block below this has any free space
+
+	virtual void db_open(uint flags=0);
+	virtual void put_page(uint page);
+	virtual void put_header(BlockID block_id);
+};
+
 /**
  * @class HeapFile - heap file implementation of DbFile
  *
  * Heap file organization. Built on top of Berkeley DB RecNo file. There is one of our
-        database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
-        for buffer management and file management.
+        database blocks for each Berkeley DB record in the RecNo file. Berkeley DB does the file
+        management; blocks are cached in the BufferPool, so get() of a cached block is just a lookup
+        and put() just marks it dirty.
+        The file grows EXTENT empty blocks at a time with a single bulk put, and get_new() hands
+        them out without any I/O. The high-water mark is kept in the free-space map's header.
         Uses SlottedPage for storing records within blocks.
  */
 class HeapFile : public DbFile {
+	friend class BufferPool;
 public:
 	HeapFile(std::string name);
-	virtual ~HeapFile() {}
+	virtual ~HeapFile();
 	HeapFile(const HeapFile& other) = delete;
 	HeapFile(HeapFile&& temp) = delete;
 	HeapFile& operator=(const HeapFile& other) = delete;
@@ -82,8 +196,55 @@ public:
 	virtual void close(void);
 	virtual SlottedPage* get_new(void);
 	virtual SlottedPage* get(BlockID block_id);
+	virtual SlottedPage* get(BlockID block_id, BufferRing* ring);
 	virtual void put(DbBlock* block);
-	virtual BlockIDs* block_ids() const;
+	virtual BlockRange blocks() const {return BlockRange(1, last + 1);}
+
+	/**
+	 * Write out all the blocks changed so far (and the free-space map), leaving the file open.
+	 */
+	virtual void flush();
+
+	/**
+	 * Number of blocks the file is grown by at a time.
+	 */
+	static const uint EXTENT = 16;
+
+	/**
+	 * Number of blocks a sequential scan asks for at a time with read_ahead.
+	 */
+	static const uint READ_AHEAD = 8;
+
+	/**
+	 * Bring the blocks [start, start + count) into the buffer pool with a single bulk cursor
+	 * read, so that the get() of each of them is just a lookup. Blocks already cached are
+	 * left alone.
+	 * @param start  first block id
+	 * @param count  number of blocks
+	 * @param ring   frames to recycle for a sequential scan (nullptr for normal access)
+	 */
+	virtual void read_ahead(BlockID start, uint count, BufferRing* ring=nullptr);
+
+	/**
+	 * Add whole blocks after the high-water mark, written straight to the file rather than
+	 * through the buffer pool (bulk load).
+	 * @param blocks  DbBlock::BLOCK_SZ bytes each, laid out as SlottedPages
+	 * @returns       block id of the first of them
+	 */
+	virtual BlockID append_blocks(const std::vector<char*>& blocks);
+
+	/**
+	 * Find a block with room for a new record, according to the free-space map.
+	 * @param size  size of the record's data
+	 * @returns     block id, or 0 if none is known to have room
+	 */
+	virtual BlockID find_room(uint16_t size) {return fsm.find(size);}
+
+	/**
+	 * Note the current free space of a block without writing it (e.g., after a failed add).
+	 * @param block  the block
+	 */
+	virtual void note_free_space(DbBlock* block) {fsm.update(block->get_block_id(), block->free_space());}
 
 	/**
 	 * Get the id of the current final block in the heap file.
@@ -93,21 +254,257 @@ public:
 
 protected:
 	std::string dbfilename;
-	uint32_t last;
+	uint32_t last;       // high-water mark: blocks after this are allocated but not yet handed out
+	uint32_t allocated;  // blocks in the Berkeley DB file
 	bool closed;
 	Db db;
+	FreeSpaceMap fsm;
 	virtual void db_open(uint flags=0);
 	virtual uint32_t get_block_count();
+	virtual void extend();
+	virtual void appended(BlockID first, const std::vector<char*>& blocks);
+	virtual void read_block(BlockID block_id, char* buffer);
+	virtual void write_block(BlockID block_id, const char* buffer);
+	virtual void write_blocks(const std::vector<BufferFrame*>& frames);
+	static std::string environment_path(std::string filename);
+};
+
+/**
+ * @class RowLayout - how a table's rows are laid out in its records, worked out once from its columns
+ *
+ * A record holds the columns in order: an INT as 4 bytes, a BOOLEAN as 1 byte, and a TEXT as a
+ * 2-byte length followed by its characters. In the OFFSET_ARRAY format, the record starts with a
+ * 2-byte offset for each column that comes after a TEXT column, so any column can be found without
+ * going through the ones before it (the others are always at the same place). INLINE records
+ * (the original format) have no offsets, so finding a column past a TEXT means walking up to it.
+ *
+ * The layout keeps each column's type by ordinal, where each column is when that is fixed, and the
+ * order of the columns by name (the order of a ValueDict), so encode() walks the row's dictionary
+ * alongside the columns instead of looking each one up, and sizes the record exactly before
+ * allocating it, and decode() adds each value to the dictionary at the end, without searching it.
+ */
+class RowLayout {
+public:
+	/**
+	 * Record formats (as kept in _tables.record_format).
+	 */
+	enum Format {
+		INLINE = 1,
+		OFFSET_ARRAY = 2
+	};
+
+	/**
+	 * Offset of a column that comes after a TEXT column (so it depends on the record).
+	 */
+	static const uint VARIABLE = UINT32_MAX;
+
+	RowLayout(const ColumnNames& column_names, const ColumnAttributes& column_attributes, Format format=INLINE);
+	virtual ~RowLayout() {}
+
+	/**
+	 * Lay out a row as a record.
+	 * @param row  the row, with (at least) a value for every column
+	 * @returns    the record, in a new[] buffer exactly its size (caller frees it and the Dbt)
+	 */
+	virtual Dbt* encode(const ValueDict* row) const;
+
+	/**
+	 * Get a row back from a record. Columns past the end of a short INLINE record (written before
+	 * they were added to the table) are left out.
+	 * @param data   the record
+	 * @param arena  where to build the row (nullptr for the heap)
+	 * @returns      the row, with the layout's schema (freed by caller, or with the arena)
+	 */
+	virtual Row* decode(const Dbt* data, Arena* arena=nullptr) const;
+
+	/**
+	 * Get just some of the columns from a record.
+	 * @param data     the record
+	 * @param columns  the columns wanted
+	 * @param arena    where to build the row (nullptr for the heap)
+	 * @returns        a row of those columns (freed by caller, or with the arena)
+	 */
+	virtual Row* decode(const Dbt* data, const RowSchema& columns, Arena* arena=nullptr) const;
+
+	/**
+	 * Decode a batch of records onto the end of a chunk, a column at a time (so each column is one
+	 * tight loop, straight from the records' fields into the chunk's vector).
+	 * @param records     each record's bytes
+	 * @param record_szs  their sizes
+	 * @param n           how many records (no more than the chunk has room for)
+	 * @param ordinals    the ordinal of each of the chunk's columns
+	 * @param chunk       the chunk (its TEXT values are left pointing into the records)
+	 */
+	virtual void decode(const char* const* records, const u_int16_t* record_szs, uint n,
+						const std::vector<uint>& ordinals, DataChunk& chunk) const;
+
+	/**
+	 * @class RowLayout::Filter - a conjunction of column comparisons compiled against a layout
+	 */
+	class Filter {
+		friend class RowLayout;
+	public:
+		Filter() : terms(), impossible(false) {}
+		bool empty() const {return terms.empty() && !impossible;}
+	protected:
+		struct Term {
+			uint ordinal;
+			ColumnAttribute::DataType type;
+			uint offset;           // where the field is in every record, or VARIABLE
+			FilterKernels::Op op;  // always EQUAL for TEXT
+			int32_t n;             // value compared against (INT, BOOLEAN)
+			int32_t high;          // upper end for BETWEEN
+			std::string s;         // value wanted (TEXT)
+		};
+		std::vector<Term> terms;  // in column order, so an INLINE record is walked just once
+		bool impossible;          // a value of the wrong type for its column, so nothing matches
+	};
+
+	/**
+	 * Work out, once, which field each value of a where clause is checked against and how.
+	 * @param where  values a record must have, keyed by column name (nullptr matches everything)
+	 * @returns      the filter for matches()
+	 */
+	virtual Filter compile(const ValueDict* where) const;
+
+	/**
+	 * Add a comparison to a filter (compile() makes an EQUAL one for each value of a where clause).
+	 * @param filter       the filter
+	 * @param column_name  column compared
+	 * @param op           how (TEXT columns can only be compared with EQUAL)
+	 * @param value        value compared against
+	 * @param high         upper end, for BETWEEN
+	 */
+	virtual void restrict(Filter& filter, const Identifier& column_name, FilterKernels::Op op, const Value& value,
+						  const Value& high=Value()) const;
+
+	/**
+	 * Does a record pass a filter? Checked in place, without decoding the record.
+	 * @param record     the record's bytes
+	 * @param record_sz  its size
+	 * @param filter     from compile()
+	 * @returns          true if every one of the filter's values matches
+	 */
+	virtual bool matches(const char* record, uint record_sz, const Filter& filter) const;
+
+	/**
+	 * Check a batch of records (e.g., a block's) against a filter a term at a time: each INT or
+	 * BOOLEAN term gathers its column's values from all the records and compares them at once
+	 * with a FilterKernels kernel.
+	 * @param records     each record's bytes
+	 * @param record_szs  their sizes
+	 * @param n           how many records
+	 * @param filter      from compile()
+	 * @param bitmap      (n + 63) / 64 words; bits of records failing the filter are cleared
+	 */
+	virtual void select(const char* const* records, const u_int16_t* record_szs, uint n, const Filter& filter,
+						uint64_t* bitmap) const;
+
+	/**
+	 * Number of columns.
+	 */
+	virtual uint size() const {return (uint)types.size();}
+
+	virtual Format get_format() const {return format;}
+
+	/**
+	 * The names of all the columns, shared by the rows decode() returns.
+	 */
+	virtual const RowSchema& get_schema() const {return schema;}
+
+	/**
+	 * Find a column.
+	 * @param column_name  its name
+	 * @returns            its ordinal (0 for the first column), or -1 if there is no such column
+	 */
+	virtual int ordinal(const Identifier& column_name) const;
+
+	/**
+	 * Where a column is in every record, if that is fixed.
+	 * @param ordinal  column number
+	 * @returns        byte offset, or VARIABLE
+	 */
+	virtual uint fixed_offset(uint ordinal) const {
+		return fixed_offsets[ordinal] == VARIABLE ? VARIABLE : header_sz + fixed_offsets[ordinal];
+	}
+
+	/**
+	 * Where a column is in a given record: constant time unless the format is INLINE and the
+	 * column comes after a TEXT column.
+	 * @param record   the record's bytes
+	 * @param ordinal  column number
+	 * @returns        byte offset of the column's field
+	 */
+	virtual uint offset(const char* record, uint ordinal) const;
+
+	/**
+	 * Same, for a record that may be too short to have the column (an INLINE record written before
+	 * columns were added to the table): the walk stops at the end of the record.
+	 * @param record     the record's bytes
+	 * @param record_sz  its size
+	 * @param ordinal    column number
+	 * @returns          byte offset of the column's field (record_sz or more if the record does not have it)
+	 */
+	virtual uint offset(const char* record, uint record_sz, uint ordinal) const;
+
+protected:
+	ColumnNames column_names;
+	RowSchema schema;
+	Format format;
+	std::vector<ColumnAttribute::DataType> types;  // by ordinal
+	std::vector<uint> fixed_offsets;               // by ordinal, from the end of the header
+	std::vector<uint> slots;                       // by ordinal, the column's entry in the offset array
+	std::vector<uint> by_name;                     // ordinals, in column name order
+	uint header_sz;                                // bytes of offset array at the front of each record
+	uint fixed_sz;                                 // bytes of the header plus all but TEXT columns' characters
+
+	static const uint STACK_COLUMNS = 64;          // tables up to this wide need no scratch allocation
+	virtual uint field_size(ColumnAttribute::DataType type) const;
+	virtual uint locate(const char* record, uint record_sz, uint count, uint* offsets) const;
+	virtual void get_value(const char* field, uint ordinal, Value& value) const;
 };
 
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ * The blocks are kept in a Berkeley DB HeapFile (HEAP), a memory-mapped MmapFile (MMAP), or a
+ * DirectFile doing O_DIRECT I/O through io_uring (DIRECT), and its records are laid out in one of the
+ * RowLayout formats, both as recorded for the table in the _tables catalog.
+ *
+ * A scan of more than one morsel (MORSEL blocks) is spread over scan_threads worker threads, each
+ * taking the next morsel not yet scanned until there are none left; the handles each morsel turns up
+ * are put back together in block order. A cursor() hands them out a morsel at a time as the caller
+ * pulls them, with the workers kept at most a few morsels ahead of it. A cursor() over some columns
+ * decodes them into DataChunks instead, a block at a time on the caller's thread.
  */
 
 class HeapTable : public DbRelation {
 public:
-	HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes );
-	virtual ~HeapTable() {}
+	enum StorageEngine {
+		HEAP,
+		MMAP,
+		DIRECT
+	};
+
+	/**
+	 * Number of blocks a scan worker takes at a time.
+	 */
+	static const uint MORSEL = 64;
+
+	/**
+	 * Number of worker threads a scan uses (0, the default, for one per core; 1 to scan on the caller's thread).
+	 */
+	static uint scan_threads;
+
+	/**
+	 * Write out everything inserted or deleted so far in every table that has a HeapTable around
+	 * (e.g., before exiting).
+	 */
+	static void checkpoint_files();
+
+	HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+			  StorageEngine storage_engine=HEAP, RowLayout::Format record_format=RowLayout::INLINE);
+	virtual ~HeapTable();
 	HeapTable(const HeapTable& other) = delete;
 	HeapTable(HeapTable&& temp) = delete;
 	HeapTable& operator=(const HeapTable& other) = delete;
@@ -119,27 +516,70 @@ public:
 
 	virtual void open();
 	virtual void close();
+	virtual void checkpoint();
 
 	virtual Handle insert(const ValueDict* row);
+	virtual Handles* insert_many(const ValueDicts& rows);
+	virtual void pack(const ValueDicts& rows, std::vector<char*>& blocks) const;
+	virtual Handles* append_blocks(const std::vector<char*>& blocks);
 	virtual void update(const Handle handle, const ValueDict* new_values);
 	virtual void del(const Handle handle);
 
 	virtual Handles* select();
 	virtual Handles* select(const ValueDict* where);
+	virtual Handles* select(const ValueDict* where, DbFile::AccessHint hint);
 	// porting from Milestone5_prep
 	virtual Handles* select(Handles *current_selection, const ValueDict* where);
-	virtual ValueDict* project(Handle handle);
-	virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
+	virtual DbCursor* cursor(const ValueDict* where, DbFile::AccessHint hint=DbFile::NORMAL);
+	virtual DbCursor* cursor(const ValueDict* where, const ColumnNames& columns,
+							 DbFile::AccessHint hint=DbFile::NORMAL);
+	virtual BlockID get_block_count();
+	virtual Row* project(Handle handle);
+	virtual Row* project(Handle handle, const RowSchema& columns);
+	virtual Rows* project(Handles* handles, Arena* arena=nullptr);
+	virtual Rows* project(Handles* handles, const RowSchema& columns, Arena* arena=nullptr);
 	using DbRelation::project;
 
 protected:
-	HeapFile file;
+	class Cursor;
+	class ChunkCursor;
+
+	/**
+	 * What all the HeapTables on one table share: its HeapFile, so they see the same cached blocks,
+	 * free-space map, and high-water mark, and the page they append to.
+	 */
+	struct SharedFile {
+		SharedFile(HeapFile* file) : file(file), insert_page(nullptr), insert_page_dirty(false), users(0) {}
+		void release_insert_page();
+
+		HeapFile* file;
+		SlottedPage* insert_page;  // block appends go to, kept pinned until they move on or it is checkpointed
+		bool insert_page_dirty;    // has records added by insert_many that it has not put yet
+		uint users;                // HeapTables using it
+	};
+	static std::map<Identifier, SharedFile*> shared_files;
+
+	SharedFile* shared;
+	HeapFile* file;  // shared->file
+	RowLayout layout;
+	virtual void release_insert_page();
+	virtual SlottedPage* page_for(u_int16_t size);
 	virtual ValueDict* validate(const ValueDict* row) const;
 	virtual Handle append(const ValueDict* row);
 	virtual Dbt* marshal(const ValueDict* row) const;
-	virtual ValueDict* unmarshal(Dbt* data) const;
+	virtual Row* unmarshal(Dbt* data) const;
+	virtual Row* decode(SlottedPage* block, RecordID record_id, const RowSchema& columns, Arena* arena) const;
 	virtual bool selected(Handle handle, const ValueDict* where);
+	virtual bool selected(SlottedPage* block, RecordID record_id, const RowLayout::Filter& filter);
+	virtual void scan(BlockRange blocks, const RowLayout::Filter& filter, BufferRing* ring, Handles* handles);
+	virtual void select(SlottedPage* block, const RowLayout::Filter& filter, std::vector<const char*>& records,
+						std::vector<u_int16_t>& record_szs, std::vector<RecordID>& record_ids,
+						std::vector<uint64_t>& bitmap, Handles* handles);
 };
 
 bool test_heap_storage();
+void benchmark_block_iteration();
+void benchmark_row_layout();
+void benchmark_select_allocations();
+void benchmark_vectorized_scan();
 
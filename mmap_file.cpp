@@ -0,0 +1,168 @@
+/**
+ * @file mmap_file.cpp - implementation of:
+ * MmapFile
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mmap_file.h"
+using namespace std;
+
+MmapFile::MmapFile(string name) : HeapFile(name), path(environment_path(name + ".mmap")), fd(-1), base(nullptr) {
+}
+
+MmapFile::~MmapFile() {
+	close();
+}
+
+// Create physical file.
+void MmapFile::create(void) {
+	map_open(O_RDWR|O_CREAT|O_EXCL);
+	this->fsm.create();
+	SlottedPage *page = get_new(); // force one page to exist
+	delete page;
+}
+
+// Delete the physical file.
+void MmapFile::drop(void) {
+	close();
+	unlink(this->path.c_str());
+	this->fsm.drop();
+}
+
+// Open physical file.
+void MmapFile::open(void) {
+	if (!this->closed)
+		return;
+	map_open(O_RDWR);
+	this->fsm.open();
+	this->last = this->fsm.get_high_water();
+	if (this->last == 0 || this->last > this->allocated)
+		this->last = this->allocated;
+}
+
+// Write the mapped blocks out and unmap the file.
+void MmapFile::close(void) {
+	if (this->closed)
+		return;
+	if (this->allocated > 0)
+		msync(this->base, (size_t)this->allocated * DbBlock::BLOCK_SZ, MS_SYNC);
+	munmap(this->base, MAX_SZ);
+	::close(this->fd);
+	this->base = nullptr;
+	this->fd = -1;
+	this->fsm.close();
+	this->closed = true;
+}
+
+// Allocate a new block, formatted in place in the mapping.
+SlottedPage* MmapFile::get_new(void) {
+	if (this->last >= this->allocated)
+		extend();
+	BlockID block_id = ++this->last;
+	Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+	SlottedPage* page = new SlottedPage(data, block_id, true);
+	this->fsm.update(block_id, page->free_space());
+	this->fsm.set_high_water(block_id);
+	return page;
+}
+
+// Get a block: the page is the mapped memory itself.
+SlottedPage* MmapFile::get(BlockID block_id) {
+	if (block_id == 0 || block_id > this->last)
+		throw DbRelationError("cannot read block " + to_string(block_id) + " of " + this->path);
+	Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+	return new SlottedPage(data, block_id, false);
+}
+
+// There are no buffer pool frames to recycle, so a scan's ring is not needed.
+SlottedPage* MmapFile::get(BlockID block_id, BufferRing* ring) {
+	return get(block_id);
+}
+
+// Changes are already in the mapping; copy in a block that was built somewhere else.
+void MmapFile::put(DbBlock* block) {
+	char* mapped = address(block->get_block_id());
+	if (block->get_data() != mapped)
+		memcpy(mapped, block->get_data(), DbBlock::BLOCK_SZ);
+	this->fsm.update(block->get_block_id(), block->free_space());
+}
+
+// Force the mapped blocks out to the file.
+void MmapFile::flush() {
+	if (this->closed)
+		return;
+	if (this->allocated > 0)
+		msync(this->base, (size_t)this->allocated * DbBlock::BLOCK_SZ, MS_SYNC);
+	this->fsm.flush();
+}
+
+// Ask the kernel to start paging in the blocks.
+void MmapFile::read_ahead(BlockID start, uint count, BufferRing* ring) {
+	BlockID stop = min(start + count, this->last + 1);
+	if (start < stop)
+		madvise(address(start), (size_t)(stop - start) * DbBlock::BLOCK_SZ, MADV_WILLNEED);
+}
+
+// Map enough extents for the blocks and copy them in.
+BlockID MmapFile::append_blocks(const vector<char*>& blocks) {
+	BlockID first = this->last + 1;
+	while (this->last + blocks.size() > this->allocated)
+		extend();
+	for (size_t i = 0; i < blocks.size(); i++)
+		memcpy(address(first + i), blocks[i], DbBlock::BLOCK_SZ);
+	appended(first, blocks);
+	return first;
+}
+
+// Open the file, reserve the address space, and map whatever is already in the file.
+void MmapFile::map_open(int flags) {
+	if (!this->closed)
+		return;
+	this->fd = ::open(this->path.c_str(), flags, 0644);
+	if (this->fd < 0)
+		throw DbRelationError("cannot open " + this->path + ": " + strerror(errno));
+	struct stat st;
+	if (fstat(this->fd, &st) < 0) {
+		string error = strerror(errno);
+		::close(this->fd);
+		throw DbRelationError("cannot stat " + this->path + ": " + error);
+	}
+	this->allocated = (uint32_t)(st.st_size / DbBlock::BLOCK_SZ);
+
+	void* reserved = mmap(nullptr, MAX_SZ, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (reserved == MAP_FAILED) {
+		::close(this->fd);
+		throw DbRelationError("cannot reserve address space for " + this->path);
+	}
+	this->base = (char*)reserved;
+	if (this->allocated > 0 && mmap(this->base, (size_t)this->allocated * DbBlock::BLOCK_SZ, PROT_READ|PROT_WRITE,
+									MAP_SHARED|MAP_FIXED, this->fd, 0) == MAP_FAILED) {
+		munmap(this->base, MAX_SZ);
+		::close(this->fd);
+		throw DbRelationError("cannot map " + this->path);
+	}
+	this->last = this->allocated;
+	this->closed = false;
+}
+
+// Grow the file by EXTENT blocks, map them, and format them as empty pages.
+void MmapFile::extend() {
+	uint64_t offset = (uint64_t)this->allocated * DbBlock::BLOCK_SZ;
+	size_t extent_sz = (size_t)EXTENT * DbBlock::BLOCK_SZ;
+	if (offset + extent_sz > MAX_SZ)
+		throw DbRelationError(this->path + " is full");
+	if (ftruncate(this->fd, (off_t)(offset + extent_sz)) != 0
+			|| mmap(this->base + offset, extent_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED,
+					this->fd, (off_t)offset) == MAP_FAILED)
+		throw DbRelationError("cannot extend " + this->path);
+	for (BlockID block_id = this->allocated + 1; block_id <= this->allocated + EXTENT; block_id++) {
+		Dbt data(address(block_id), DbBlock::BLOCK_SZ);
+		SlottedPage format(data, block_id, true);
+	}
+	this->allocated += EXTENT;
+	this->fsm.write_high_water(this->allocated);
+}
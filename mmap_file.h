@@ -0,0 +1,55 @@
+/**
+ * @file mmap_file.h - memory-mapped alternative to the Berkeley DB heap file
+ * MmapFile: HeapFile
+ */
+#pragma once
+
+#include "heap_storage.h"
+
+/**
+ * @class MmapFile - heap file kept in a plain file of 4kB blocks that is mapped into memory
+ *
+ * Block n is at offset (n - 1) * BLOCK_SZ of <name>.mmap in the database environment's directory.
+ * The SlottedPages returned by get() and get_new() work directly on the mapped memory, so there is
+ * no copy in or out and no buffer pool frame involved: put() just updates the free-space map, and
+ * the kernel writes the pages back (close() forces it with msync).
+ *
+ * A large range of address space is reserved when the file is opened and the file is mapped into
+ * the front of it, an extent at a time as it grows, so block addresses never move.
+ * The free-space map and high-water mark are kept the same way as for HeapFile.
+ */
+class MmapFile : public HeapFile {
+public:
+	/**
+	 * Address space reserved for the mapping, which limits the size of the file (16GB).
+	 */
+	static const uint64_t MAX_SZ = (uint64_t)1 << 34;
+
+	MmapFile(std::string name);
+	virtual ~MmapFile();
+	MmapFile(const MmapFile& other) = delete;
+	MmapFile(MmapFile&& temp) = delete;
+	MmapFile& operator=(const MmapFile& other) = delete;
+	MmapFile& operator=(MmapFile&& temp) = delete;
+
+	virtual void create(void);
+	virtual void drop(void);
+	virtual void open(void);
+	virtual void close(void);
+	virtual SlottedPage* get_new(void);
+	virtual SlottedPage* get(BlockID block_id);
+	virtual SlottedPage* get(BlockID block_id, BufferRing* ring);
+	virtual void put(DbBlock* block);
+	virtual void flush();
+	virtual void read_ahead(BlockID start, uint count, BufferRing* ring=nullptr);
+	virtual BlockID append_blocks(const std::vector<char*>& blocks);
+
+protected:
+	std::string path;
+	int fd;
+	char* base;  // start of the reserved address space (block 1)
+
+	virtual void map_open(int flags);
+	virtual void extend();
+	virtual char* address(BlockID block_id) const {return base + (uint64_t)(block_id - 1) * DbBlock::BLOCK_SZ;}
+};
@@ -3,6 +3,8 @@
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Summer 2018"
  */
+#include <functional>
+#include <unordered_set>
 #include "schema_tables.h"
 #include "ParseTreeToString.h"
 #include "btree.h"
@@ -18,6 +20,9 @@ void initialize_schema_tables() {
     Indices indices;
     indices.create_if_not_exists();
     indices.close();
+    Statistics statistics;
+    statistics.create_if_not_exists();
+    statistics.close();
 }
 
 // Not terribly useful since the parser weeds most of these out
@@ -47,14 +52,20 @@ bool is_acceptable_data_type(std::string dt) {
  * ***************************
  */
 const Identifier Tables::TABLE_NAME = "_tables";
+const Identifier Tables::HEAP = "HEAP";
+const Identifier Tables::MMAP = "MMAP";
+const Identifier Tables::DIRECT = "DIRECT";
 Columns* Tables::columns_table = nullptr;
 std::map<Identifier,DbRelation*> Tables::table_cache;
 
 // get the column name for _tables column
 ColumnNames& Tables::COLUMN_NAMES() {
     static ColumnNames cn;
-    if (cn.empty())
+    if (cn.empty()) {
         cn.push_back("table_name");
+        cn.push_back("storage_engine");
+        cn.push_back("record_format");
+    }
     return cn;
 }
 
@@ -64,22 +75,34 @@ ColumnAttributes& Tables::COLUMN_ATTRIBUTES() {
     if (cas.empty()) {
         ColumnAttribute ca(ColumnAttribute::TEXT);
         cas.push_back(ca);
+        cas.push_back(ca);
+        ca.set_data_type(ColumnAttribute::INT);
+        cas.push_back(ca);
     }
     return cas;
 }
 
-// ctor - we have a fixed table structure of just one column: table_name
+// ctor - we have a fixed table structure: table_name, storage_engine, record_format
+// Any instance will do for the cache, since they all share the file; the first stays until it is deleted.
 Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
-    Tables::table_cache[TABLE_NAME] = this;
+    if (Tables::table_cache.find(TABLE_NAME) == Tables::table_cache.end())
+        Tables::table_cache[TABLE_NAME] = this;
     if (Tables::columns_table == nullptr)
         columns_table = new Columns();
     Tables::table_cache[columns_table->TABLE_NAME] = columns_table;
 }
 
+Tables::~Tables() {
+    auto cached = Tables::table_cache.find(TABLE_NAME);
+    if (cached != Tables::table_cache.end() && cached->second == this)
+        Tables::table_cache.erase(cached);
+}
+
 // Create the file and also, manually add schema tables.
 void Tables::create() {
     HeapTable::create();
     ValueDict row;
+    row["record_format"] = Value(RowLayout::INLINE);  // the schema tables' own records
     row["table_name"] = Value("_tables");
     insert(&row);
     row["table_name"] = Value("_columns");
@@ -88,22 +111,36 @@ void Tables::create() {
     insert(&row);
 }
 
-// Manually check that table_name is unique.
+// Manually check that table_name is unique. The storage_engine defaults to HEAP and the
+// record_format to OFFSET_ARRAY.
 Handle Tables::insert(const ValueDict* row) {
     // Try SELECT * FROM _tables WHERE table_name = row["table_name"] and it should return nothing
-    Handles* handles = select(row);
+    ValueDict where;
+    where["table_name"] = row->at("table_name");
+    Handles* handles = select(&where);
     bool unique = handles->empty();
     delete handles;
     if (!unique)
         throw DbRelationError(row->at("table_name").s + " already exists");
-    return HeapTable::insert(row);
+
+    ValueDict full_row = *row;
+    if (full_row.find("storage_engine") == full_row.end())
+        full_row["storage_engine"] = Value(HEAP);
+    else if (full_row["storage_engine"].s != HEAP && full_row["storage_engine"].s != MMAP
+             && full_row["storage_engine"].s != DIRECT)
+        throw DbRelationError("unknown storage engine " + full_row["storage_engine"].s);
+    if (full_row.find("record_format") == full_row.end())
+        full_row["record_format"] = Value(RowLayout::OFFSET_ARRAY);
+    else if (full_row["record_format"].n != RowLayout::INLINE && full_row["record_format"].n != RowLayout::OFFSET_ARRAY)
+        throw DbRelationError("unknown record format " + std::to_string(full_row["record_format"].n));
+    return HeapTable::insert(&full_row);
 }
 
 // Remove a row, but first remove from table cache if there
 // NOTE: once the row is deleted, any reference to the table (from get_table() below) is gone! So drop the table first.
 void Tables::del(Handle handle) {
     // remove from cache, if there
-    ValueDict* row = project(handle);
+    Row* row = project(handle);
     Identifier table_name = row->at("table_name").s;
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end()) {
         DbRelation* table = Tables::table_cache.at(table_name);
@@ -122,7 +159,7 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
 
     ColumnAttribute column_attribute;
     for (auto const& handle: *handles) {
-        ValueDict* row = Tables::columns_table->project(handle);  // get the row's values: {'column_name': <name>, 'data_type': <type>}
+        Row* row = Tables::columns_table->project(handle);  // get the row's values: {'column_name': <name>, 'data_type': <type>}
 
         Identifier column_name = (*row)["column_name"].s;
         column_names.push_back(column_name);
@@ -144,17 +181,66 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
     delete handles;
 }
 
+// Return the storage_engine recorded for table_name (rows from before there was a choice are HEAP).
+Identifier Tables::get_storage_engine(Identifier table_name) {
+    // SELECT storage_engine FROM _tables WHERE table_name = <table_name>
+    DbRelation& tables = *Tables::table_cache.at(TABLE_NAME);
+    ValueDict where;
+    where["table_name"] = table_name;
+    Handles* handles = tables.select(&where);
+    Identifier storage_engine = HEAP;
+    for (auto const& handle: *handles) {
+        Row* row = tables.project(handle);
+        if (row->has("storage_engine"))
+            storage_engine = (*row)["storage_engine"].s;
+        delete row;
+    }
+    delete handles;
+    return storage_engine;
+}
+
+// Return the record_format recorded for table_name (rows from before there was a choice are INLINE).
+RowLayout::Format Tables::get_record_format(Identifier table_name) {
+    // SELECT record_format FROM _tables WHERE table_name = <table_name>
+    DbRelation& tables = *Tables::table_cache.at(TABLE_NAME);
+    ValueDict where;
+    where["table_name"] = table_name;
+    Handles* handles = tables.select(&where);
+    RowLayout::Format record_format = RowLayout::INLINE;
+    ColumnNames column_names = {"record_format"};
+    for (auto const& handle: *handles) {
+        Row* row = tables.project(handle, &column_names);
+        if (row->has("record_format"))
+            record_format = (RowLayout::Format)(*row)["record_format"].n;
+        delete row;
+    }
+    delete handles;
+    return record_format;
+}
+
+// Goes by file rather than through the cache, which does not have SQLExec's Indices and Statistics.
+void Tables::checkpoint_all() {
+    HeapTable::checkpoint_files();
+}
+
 // Return a table for given table_name.
 DbRelation& Tables::get_table(Identifier table_name) {
     // if they are asking about a table we've once constructed, then just return that one
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end())
         return  *Tables::table_cache[table_name];
 
-    // otherwise assume it is a HeapTable (for now)
+    // otherwise it is a HeapTable, with its blocks kept and its records laid out however _tables says
     ColumnNames column_names;
     ColumnAttributes column_attributes;
     get_columns(table_name, column_names, column_attributes);
-    DbRelation* table = new HeapTable(table_name, column_names, column_attributes);
+    Identifier engine = get_storage_engine(table_name);
+    HeapTable::StorageEngine storage_engine = HeapTable::HEAP;
+    if (engine == MMAP)
+        storage_engine = HeapTable::MMAP;
+    else if (engine == DIRECT)
+        storage_engine = HeapTable::DIRECT;
+    DbRelation* table = new HeapTable(table_name, column_names, column_attributes, storage_engine,
+                                      get_record_format(table_name));
     Tables::table_cache[table_name] = table;
     return *table;
 }
@@ -202,6 +288,12 @@ void Columns::create() {
     row["table_name"] = Value("_tables");
     row["column_name"] = Value("table_name");
     insert(&row);
+    row["column_name"] = Value("storage_engine");
+    insert(&row);
+    row["column_name"] = Value("record_format");
+    row["data_type"] = Value("INT");
+    insert(&row);
+    row["data_type"] = Value("TEXT");
 
     row["table_name"] = Value("_columns");
     row["column_name"] = Value("table_name");
@@ -323,7 +415,7 @@ Handle Indices::insert(const ValueDict* row) {
 // NOTE: once the row is deleted, any reference to the index (from get_index() below) is gone! So drop the index
 void Indices::del(Handle handle) {
     // remove from cache, if there
-    ValueDict* row = project(handle);
+    Row* row = project(handle);
     Identifier table_name = row->at("table_name").s;
     Identifier index_name = row->at("index_name").s;
     std::pair<Identifier,Identifier> cache_key(table_name, index_name);
@@ -347,7 +439,7 @@ void Indices::get_columns(Identifier table_name, Identifier index_name,
     Identifier colnames[DbIndex::MAX_COMPOSITE];
     uint size = 0;
     for (auto const& handle: *handles) {
-        ValueDict *row = project(handle);
+        Row* row = project(handle);
 
         Identifier column_name = (*row)["column_name"].s;
         uint which = (uint) (*row)["seq_in_index"].n;
@@ -406,7 +498,7 @@ IndexNames Indices::get_index_names(Identifier table_name) {
     where["seq_in_index"] = Value(1);  // only get the row for the first column if composite index
     Handles* handles = select(&where);
     for (auto const& handle: *handles) {
-        ValueDict* row = project(handle);
+        Row* row = project(handle);
         ret.push_back((*row)["index_name"].s);
         delete row;
     }
@@ -414,3 +506,177 @@ IndexNames Indices::get_index_names(Identifier table_name) {
     return ret;
 }
 
+
+/*
+ * *******************************
+ * Statistics class implementation
+ * *******************************
+ */
+const Identifier Statistics::TABLE_NAME = "_statistics";
+
+// get the column name for _statistics column
+ColumnNames& Statistics::COLUMN_NAMES() {
+    static ColumnNames cn;
+    if (cn.empty()) {
+        cn.push_back("table_name");
+        cn.push_back("object_name");
+        cn.push_back("statistic");
+        cn.push_back("value");
+    }
+    return cn;
+}
+
+// get the column attribute for _statistics column
+ColumnAttributes& Statistics::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes cas;
+    if (cas.empty()) {
+        ColumnAttribute ca(ColumnAttribute::TEXT);
+        cas.push_back(ca);  // table_name
+        cas.push_back(ca);  // object_name
+        cas.push_back(ca);  // statistic
+        ca.set_data_type(ColumnAttribute::INT);
+        cas.push_back(ca);  // value
+    }
+    return cas;
+}
+
+// ctor - we have a fixed table structure
+Statistics::Statistics() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+}
+
+// Create the file and also, manually add it to _tables and _columns (it came after the other schema
+// tables, so a database made before it gets it here, too).
+void Statistics::create() {
+    HeapTable::create();
+    DbRelation& tables = Tables::get_table(Tables::TABLE_NAME);
+    ValueDict where;
+    where["table_name"] = Value(TABLE_NAME);
+    Handles* handles = tables.select(&where);
+    bool known = !handles->empty();
+    delete handles;
+    if (known)
+        return;
+
+    ValueDict row;
+    row["table_name"] = Value(TABLE_NAME);
+    row["record_format"] = Value(RowLayout::INLINE);  // like the other schema tables
+    tables.insert(&row);
+
+    DbRelation& columns = Tables::get_table(Columns::TABLE_NAME);
+    row.erase("record_format");
+    row["data_type"] = Value("TEXT");
+    row["column_name"] = Value("table_name");
+    columns.insert(&row);
+    row["column_name"] = Value("object_name");
+    columns.insert(&row);
+    row["column_name"] = Value("statistic");
+    columns.insert(&row);
+    row["column_name"] = Value("value");
+    row["data_type"] = Value("INT");
+    columns.insert(&row);
+}
+
+// One value of a column, boiled down for counting distinct values (a collision just undercounts by one).
+static size_t value_hash(const Value& value) {
+    if (value.data_type == ColumnAttribute::TEXT)
+        return std::hash<std::string>()(value.s);
+    return std::hash<int32_t>()(value.n) ^ ((size_t)value.data_type << 40);
+}
+
+// A sequential scan, a batch of rows at a time, hashing each column's values into a set of its own.
+TableStatistics Statistics::analyze(DbRelation& table, Indices& indices) {
+    Identifier table_name = table.get_table_name();
+    const ColumnNames& column_names = table.get_column_names();
+    TableStatistics stats;
+    stats.analyzed = true;
+    stats.rows = 0;
+    stats.blocks = table.get_block_count();
+
+    std::vector<std::unordered_set<size_t>> values(column_names.size());
+    RowSchema all = std::make_shared<const ColumnNames>(column_names);
+    DbCursor* cursor = table.cursor(nullptr, DbFile::SEQUENTIAL);
+    try {
+        Handles batch;
+        while (cursor->next(batch)) {
+            Arena arena;
+            Rows* rows = table.project(&batch, all, &arena);
+            for (auto const& row: *rows) {
+                for (uint j = 0; j < column_names.size(); j++)
+                    if (row->get_schema() == all)
+                        values[j].insert(value_hash((*row)[j]));
+                    else if (row->has(column_names[j]))  // row written before some columns were added
+                        values[j].insert(value_hash(row->at(column_names[j])));
+            }
+            stats.rows += rows->size();
+            delete rows;
+        }
+    } catch (...) {
+        delete cursor;
+        throw;
+    }
+    delete cursor;
+    for (uint j = 0; j < column_names.size(); j++)
+        stats.distinct[column_names[j]] = values[j].size();
+    for (auto const& index_name: indices.get_index_names(table_name)) {
+        ColumnNames key_columns;
+        bool is_hash, is_unique;
+        indices.get_columns(table_name, index_name, key_columns, is_hash, is_unique);
+        if (!is_hash)  // (no hash index is built yet, so it has no height to speak of)
+            stats.heights[index_name] = indices.get_index(table_name, index_name).get_height();
+    }
+
+    forget(table_name);
+    ValueDict row;
+    row["table_name"] = Value(table_name);
+    auto put = [&](const Identifier& object_name, const char* statistic, uint64_t value) {
+        row["object_name"] = Value(object_name);
+        row["statistic"] = Value(statistic);
+        row["value"] = Value((int32_t)std::min(value, (uint64_t)INT32_MAX));
+        insert(&row);
+    };
+    put("", "rows", stats.rows);
+    put("", "blocks", stats.blocks);
+    for (auto const& distinct: stats.distinct)
+        put(distinct.first, "distinct", distinct.second);
+    for (auto const& height: stats.heights)
+        put(height.first, "height", height.second);
+    return stats;
+}
+
+TableStatistics Statistics::get(Identifier table_name) {
+    // SELECT * FROM _statistics WHERE table_name = <table_name>
+    TableStatistics stats;
+    stats.analyzed = false;
+    stats.rows = 0;
+    stats.blocks = 0;
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles* handles = select(&where);
+    for (auto const& handle: *handles) {
+        Row* row = project(handle);
+        const Identifier& statistic = (*row)["statistic"].s;
+        uint64_t value = (uint64_t)(*row)["value"].n;
+        if (statistic == "rows") {
+            stats.rows = value;
+            stats.analyzed = true;
+        } else if (statistic == "blocks") {
+            stats.blocks = value;
+        } else if (statistic == "distinct") {
+            stats.distinct[(*row)["object_name"].s] = value;
+        } else if (statistic == "height") {
+            stats.heights[(*row)["object_name"].s] = (uint)value;
+        }
+        delete row;
+    }
+    delete handles;
+    return stats;
+}
+
+void Statistics::forget(Identifier table_name) {
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles* handles = select(&where);
+    for (auto const& handle: *handles)
+        del(handle);
+    delete handles;
+}
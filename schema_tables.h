@@ -2,6 +2,8 @@
  * @file schema_tables.h - schema table classes:
  * 		Columns
  * 		Tables
+ * 		Indices
+ * 		Statistics
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Summer 2018"
  */
@@ -31,9 +33,17 @@ public:
 	 */
     static const Identifier TABLE_NAME;
 
+	/**
+	 * Values of the storage_engine column: blocks in a Berkeley DB file (HEAP, the default),
+	 * in a memory-mapped file (MMAP), or in a file read and written with O_DIRECT (DIRECT)
+	 */
+    static const Identifier HEAP;
+    static const Identifier MMAP;
+    static const Identifier DIRECT;
+
 	// ctor/dtor
     Tables();
-    virtual ~Tables() {}
+    virtual ~Tables();
 
 	// HeapTable overrides
     virtual void create();
@@ -57,6 +67,25 @@ public:
 	 */
     static DbRelation& get_table(Identifier table_name);
 
+	/**
+	 * Get the storage engine a given table was created with.
+	 * @param table_name  table to look up
+	 * @returns           HEAP, MMAP, or DIRECT
+	 */
+    static Identifier get_storage_engine(Identifier table_name);
+
+	/**
+	 * Get the record format a given table was created with.
+	 * @param table_name  table to look up
+	 * @returns           RowLayout::INLINE or RowLayout::OFFSET_ARRAY
+	 */
+    static RowLayout::Format get_record_format(Identifier table_name);
+
+	/**
+	 * Checkpoint every table instantiated so far (e.g., before exiting).
+	 */
+    static void checkpoint_all();
+
 protected:
 	// hard-coded columns for _tables table
     static ColumnNames& COLUMN_NAMES();
@@ -148,3 +177,60 @@ private:
 	static std::map<std::pair<Identifier,Identifier>,DbIndex*> index_cache;
 };
 
+
+/**
+ * What the last ANALYZE of a table found (as kept in _statistics), for the optimizer's cost estimates.
+ */
+struct TableStatistics {
+	bool analyzed;                             // false if the table has not been analyzed (the rest is empty)
+	uint64_t rows;
+	uint64_t blocks;
+	std::map<Identifier, uint64_t> distinct;   // number of distinct values, by column
+	std::map<Identifier, uint> heights;        // levels of each index, by index name
+};
+
+/**
+ * @class Statistics - The singleton table that stores the statistics gathered by ANALYZE for each table.
+ * A row is one statistic: of the table as a whole ("rows", "blocks"), of one of its columns ("distinct"),
+ * or of one of its indices ("height"), named by object_name (empty for the table).
+ */
+class Statistics : public HeapTable {
+public:
+	/**
+	 * Name of the statistics table ("_statistics")
+	 */
+	static const Identifier TABLE_NAME;
+
+	// ctor/dtor
+	Statistics();
+	virtual ~Statistics() {}
+
+	// HeapTable overrides
+	virtual void create();
+
+	/**
+	 * Gather the statistics of a table (replacing any from before): count its rows, blocks, and the
+	 * distinct values of each column in one scan, and get the height of each of its indices.
+	 * @param table    the table
+	 * @param indices  the _indices table, to find the table's indices
+	 * @returns        what was gathered
+	 */
+	virtual TableStatistics analyze(DbRelation& table, Indices& indices);
+
+	/**
+	 * Get the statistics of a table.
+	 * @param table_name  the table
+	 * @returns           its statistics (not analyzed if it has none)
+	 */
+	virtual TableStatistics get(Identifier table_name);
+
+	/**
+	 * Remove the statistics of a table (e.g., when it is dropped).
+	 * @param table_name  the table
+	 */
+	virtual void forget(Identifier table_name);
+
+protected:
+	static ColumnNames& COLUMN_NAMES();
+	static ColumnAttributes& COLUMN_ATTRIBUTES();
+};
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <cstring>
+#include <strings.h>
 #include <iostream>
 #include <string>
 #include <cassert>
@@ -13,6 +14,7 @@
 #include "SQLParser.h"
 #include "ParseTreeToString.h"
 #include "SQLExec.h"
+#include "EvalPlan.h"
 using namespace std;
 using namespace hsql;
 
@@ -42,10 +44,93 @@ int main(int argc, char *argv[]) {
 		getline(cin, query);
 		if (query.length() == 0)
 			continue;  // blank line -- just skip
-		if (query == "quit")
+		if (query == "quit") {
+			Tables::checkpoint_all();        // tables' insert pages and free-space maps
+			BufferPool::pool().flush_all();  // blocks still only in the buffer pool (e.g., of indices)
 			break;  // only way to get out
+		}
+		if (query.compare(0, 19, "set storage_engine ") == 0) {
+			// storage engine for the tables created after this: HEAP, MMAP, or DIRECT
+			try {
+				SQLExec::set_storage_engine(query.substr(19));
+				cout << "storage_engine " << query.substr(19) << endl;
+			} catch (SQLExecError& e) {
+				cout << "Error: " << e.what() << endl;
+			}
+			continue;
+		}
+		if (query.compare(0, 14, "set execution ") == 0) {
+			// how SELECTs are evaluated: ROWS (a row at a time) or VECTORIZED (a DataChunk at a time)
+			try {
+				SQLExec::set_execution(query.substr(14));
+				cout << "execution " << query.substr(14) << endl;
+			} catch (SQLExecError& e) {
+				cout << "Error: " << e.what() << endl;
+			}
+			continue;
+		}
+		if (strncasecmp(query.c_str(), "copy ", 5) == 0) {
+			// bulk load: COPY table FROM 'file' (the parser has no COPY; IMPORT goes through it)
+			char table_name[256], file_path[4096];
+			if (sscanf(query.c_str() + 5, " %255s %*[fF]%*[rR]%*[oO]%*[mM] '%4095[^']'", table_name, file_path) != 2) {
+				cout << "usage: COPY table FROM 'file'" << endl;
+				continue;
+			}
+			try {
+				QueryResult *result = SQLExec::copy(table_name, file_path);
+				cout << *result << endl;
+				delete result;
+			} catch (SQLExecError& e) {
+				cout << "Error: " << e.what() << endl;
+			}
+			continue;
+		}
+		if (strncasecmp(query.c_str(), "analyze ", 8) == 0) {
+			// gather a table's statistics for the optimizer: ANALYZE table (the parser has no ANALYZE)
+			char table_name[256];
+			if (sscanf(query.c_str() + 8, " %255s", table_name) != 1) {
+				cout << "usage: ANALYZE table" << endl;
+				continue;
+			}
+			try {
+				QueryResult *result = SQLExec::analyze(table_name);
+				cout << *result << endl;
+				delete result;
+			} catch (SQLExecError& e) {
+				cout << "Error: " << e.what() << endl;
+			}
+			continue;
+		}
+		if (strncasecmp(query.c_str(), "explain ", 8) == 0) {
+			// the plan of a SELECT or DELETE, with the optimizer's estimates (the parser has no EXPLAIN)
+			SQLParserResult* parse = SQLParser::parseSQLString(query.substr(8));
+			if (!parse->isValid()) {
+				cout << "invalid SQL: " << query.substr(8) << endl;
+				cout << parse->errorMsg() << endl;
+			} else {
+				for (uint i = 0; i < parse->size(); ++i) {
+					try {
+						QueryResult *result = SQLExec::explain(parse->getStatement(i));
+						cout << *result << endl;
+						delete result;
+					} catch (SQLExecError& e) {
+						cout << "Error: " << e.what() << endl;
+					}
+				}
+			}
+			delete parse;
+			continue;
+		}
 		if (query == "test") {
 			cout << "test_heap_storage: " << (test_heap_storage() ? "ok" : "failed") << endl;
+			cout << "test_eval_plan: " << (test_eval_plan() ? "ok" : "failed") << endl;
+			continue;
+		}
+		if (query == "bench") {
+			benchmark_block_iteration();
+			benchmark_row_layout();
+			benchmark_select_allocations();
+			benchmark_vectorized_scan();
 			continue;
 		}
 
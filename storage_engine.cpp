@@ -48,37 +48,139 @@ ColumnAttributes* DbRelation::get_column_attributes(const ColumnNames &select_co
 }
 
 // Just pulls out the column names from a ValueDict and passes that to the usual form of project().
-ValueDict* DbRelation::project(Handle handle, const ValueDict* where) {
+Row* DbRelation::project(Handle handle, const ValueDict* where) {
     ColumnNames t;
     for (auto const& column: *where)
         t.push_back(column.first);
     return this->project(handle, &t);
 }
 
+// A single row gets a schema of its own.
+Row* DbRelation::project(Handle handle, const ColumnNames* column_names) {
+    return this->project(handle, std::make_shared<const ColumnNames>(*column_names));
+}
+
+// Insert each of a list of rows
+Handles* DbRelation::insert_many(const ValueDicts& rows) {
+    Handles* handles = new Handles();
+    for (auto const& row: rows)
+        handles->push_back(insert(row));
+    return handles;
+}
+
+// Bulk loading needs a block layout, which only a storage engine that has one can provide
+void DbRelation::pack(const ValueDicts& rows, std::vector<char*>& blocks) const {
+    throw DbRelationError("bulk load not supported for " + table_name);
+}
+
+Handles* DbRelation::append_blocks(const std::vector<char*>& blocks) {
+    throw DbRelationError("bulk load not supported for " + table_name);
+}
+
+// A cursor over a selection made all at once.
+class WholeSelection : public DbCursor {
+public:
+    WholeSelection(Handles* handles) : handles(handles) {}
+    virtual ~WholeSelection() {delete handles;}
+    virtual bool next(Handles& batch) {
+        batch.clear();
+        if (this->handles == nullptr || this->handles->empty())
+            return false;
+        batch.swap(*this->handles);
+        return true;
+    }
+protected:
+    Handles* handles;
+};
+
+// Only a cursor that knows how its relation's records are laid out can decode them into chunks.
+bool DbCursor::next(DataChunk& chunk) {
+    throw DbRelationError("cursor does not decode rows");
+}
+
+DbCursor* DbRelation::cursor(const ValueDict* where, DbFile::AccessHint hint) {
+    return new WholeSelection(select(where, hint));
+}
+
+DbCursor* DbRelation::cursor(const ValueDict* where, const ColumnNames& columns, DbFile::AccessHint hint) {
+    throw DbRelationError("vectorized scan not supported for " + table_name);
+}
+
+// A row that was not built in the arena is copied into it.
+static Row* in_arena(Row* row, Arena* arena) {
+    if (arena == nullptr)
+        return row;
+    Row* copy = Row::create(row->get_schema(), arena);
+    std::copy(row->begin(), row->end(), copy->begin());
+    delete row;
+    return copy;
+}
+
 // porting from Milestone5_prep
 // Do a projection for each of a list of handles
-ValueDicts* DbRelation::project(Handles *handles) {
-    ValueDicts *ret = new ValueDicts();
+Rows* DbRelation::project(Handles *handles, Arena* arena) {
+    Rows *ret = new Rows();
+    ret->reserve(handles->size());
     for (auto const& handle: *handles)
-        ret->push_back(project(handle));
+        ret->push_back(in_arena(project(handle), arena));
     return ret;
 }
 
-// Do a projection for each of a list of handles
-ValueDicts* DbRelation::project(Handles *handles, const ColumnNames *column_names) {
-    ValueDicts *ret = new ValueDicts();
+// Do a projection for each of a list of handles (all sharing one schema)
+Rows* DbRelation::project(Handles *handles, const ColumnNames *column_names, Arena* arena) {
+    return project(handles, std::make_shared<const ColumnNames>(*column_names), arena);
+}
+
+Rows* DbRelation::project(Handles *handles, const RowSchema& columns, Arena* arena) {
+    Rows *ret = new Rows();
+    ret->reserve(handles->size());
     for (auto const& handle: *handles)
-        ret->push_back(project(handle, column_names));
+        ret->push_back(in_arena(project(handle, columns), arena));
     return ret;
 }
 
 // Do a projection for each of a list of handles
-ValueDicts* DbRelation::project(Handles *handles, const ValueDict* where) {
+Rows* DbRelation::project(Handles *handles, const ValueDict* where) {
     ColumnNames t;
     for (auto const& column: *where)
         t.push_back(column.first);
-    ValueDicts *ret = new ValueDicts();
-    for (auto const& handle: *handles)
-        ret->push_back(project(handle, &t));
-    return ret;
+    return project(handles, &t);
+}
+
+Row::Row(RowSchema schema, const ValueDict& values) : schema(schema), values() {
+    this->values.reserve(schema->size());
+    for (auto const& column_name: *schema) {
+        ValueDict::const_iterator value = values.find(column_name);
+        if (value == values.end())
+            throw DbRelationError("row has no value for column '" + column_name + "'");
+        this->values.push_back(value->second);
+    }
+}
+
+int Row::ordinal(const Identifier& column_name) const {
+    for (uint i = 0; i < this->schema->size(); i++)
+        if ((*this->schema)[i] == column_name)
+            return (int)i;
+    return -1;
+}
+
+Value& Row::at(const Identifier& column_name) {
+    int i = ordinal(column_name);
+    if (i < 0)
+        throw DbRelationError("row has no column named '" + column_name + "'");
+    return this->values[i];
+}
+
+const Value& Row::at(const Identifier& column_name) const {
+    int i = ordinal(column_name);
+    if (i < 0)
+        throw DbRelationError("row has no column named '" + column_name + "'");
+    return this->values[i];
+}
+
+ValueDict Row::to_dict() const {
+    ValueDict dict;
+    for (uint i = 0; i < this->values.size(); i++)
+        dict.emplace_hint(dict.end(), (*this->schema)[i], this->values[i]);  // hint only helps if names are in order
+    return dict;
 }
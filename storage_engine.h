@@ -11,9 +11,11 @@
 
 #include <exception>
 #include <map>
+#include <memory>
 #include <utility>
 #include <vector>
 #include "db_cxx.h"
+#include "arena.h"
 
 /**
  * Global variable to hold dbenv.
@@ -38,6 +40,7 @@ typedef std::length_error DbBlockNoRoomError;
  * 	put(record_id, data)
  * 	del(record_id)
  * 	ids()
+ * 	begin(), end()
  * Accessors:
  * 	get_block()
  * 	get_data()
@@ -92,6 +95,41 @@ public:
 	 */ 
 	virtual RecordIDs* ids() const = 0;
 
+	/**
+	 * Find the first record id, at or after the given one, that has not been deleted.
+	 * @param record_id  where to start looking
+	 * @returns          the record id found, or 0 if there are no more
+	 */
+	virtual RecordID next_id(RecordID record_id) const = 0;
+
+	/**
+	 * @class DbBlock::iterator - walks the record ids of a block (excluding deleted ones)
+	 * in place, without building a list of them like ids() does.
+	 * 	for (RecordID record_id: *block) ...
+	 */
+	class iterator {
+	public:
+		iterator(const DbBlock* block, RecordID record_id) : block(block), record_id(record_id) {}
+		RecordID operator*() const {return record_id;}
+		iterator& operator++() {record_id = block->next_id((RecordID)(record_id + 1)); return *this;}
+		bool operator==(const iterator& other) const {return record_id == other.record_id;}
+		bool operator!=(const iterator& other) const {return record_id != other.record_id;}
+	protected:
+		const DbBlock* block;
+		RecordID record_id;
+	};
+
+	/**
+	 * Cursor over the record ids in this block (excluding deleted ones).
+	 * @returns  iterator positioned at the first record id
+	 */
+	virtual iterator begin() const {return iterator(this, next_id(1));}
+
+	/**
+	 * @returns  iterator positioned past the last record id
+	 */
+	virtual iterator end() const {return iterator(this, 0);}
+
 	/**
 	 * Delete all the records from this block.
 	 */
@@ -103,6 +141,12 @@ public:
 	 */
 	virtual u_int16_t size() const = 0;
 
+	/**
+	 * Get the number of bytes of data a new record added to this block could hold.
+	 * @returns  largest record size add() would currently accept
+	 */
+	virtual u_int16_t free_space() const = 0;
+
 	/**
 	 * Access the whole block's memory as a BerkeleyDB Dbt pointer.
 	 * @returns  Dbt used by this block
@@ -126,8 +170,56 @@ protected:
 	BlockID block_id;
 };
 
-// convenience type alias
-typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an iterator at some point
+/**
+ * @class BlockRange - the block ids [first, stop) of a DbFile, generated as they are walked
+ * 	for (BlockID block_id: file.blocks()) ...
+ * A scan can stop early without having paid for the ids it never got to, and can be split
+ * into contiguous pieces with partition() to be scanned in parallel.
+ */
+class BlockRange {
+public:
+	class iterator {
+	public:
+		iterator(BlockID block_id) : block_id(block_id) {}
+		BlockID operator*() const {return block_id;}
+		iterator& operator++() {block_id++; return *this;}
+		bool operator==(const iterator& other) const {return block_id == other.block_id;}
+		bool operator!=(const iterator& other) const {return block_id != other.block_id;}
+	protected:
+		BlockID block_id;
+	};
+
+	BlockRange(BlockID first, BlockID stop) : first(first), stop(stop < first ? first : stop) {}
+
+	iterator begin() const {return iterator(first);}
+	iterator end() const {return iterator(stop);}
+
+	/**
+	 * @returns  number of blocks in the range
+	 */
+	BlockID size() const {return stop - first;}
+
+	/**
+	 * @returns  true if there are no blocks in the range
+	 */
+	bool empty() const {return stop == first;}
+
+	/**
+	 * Split the range into parts pieces of (nearly) equal size.
+	 * @param part   which piece, 0 .. parts-1
+	 * @param parts  number of pieces
+	 * @returns      the part'th piece
+	 */
+	BlockRange partition(uint part, uint parts) const {
+		BlockID n = size();
+		return BlockRange(first + (BlockID)((uint64_t)n * part / parts),
+						  first + (BlockID)((uint64_t)n * (part + 1) / parts));
+	}
+
+protected:
+	BlockID first;
+	BlockID stop;
+};
 
 /**
  * @class DbFile - abstract base class which represents a disk-based collection of DbBlocks
@@ -138,10 +230,19 @@ typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an
  * 	get_new()
  *	get(block_id)
  *	put(block)
- *	block_ids()
+ *	blocks()
  */
 class DbFile {
 public:
+	/**
+	 * How a caller is going to use the blocks it reads, so that one pass over a large file
+	 * does not push everything else out of the cache.
+	 */
+	enum AccessHint {
+		NORMAL,      // blocks are likely to be wanted again (e.g., schema tables, index nodes)
+		SEQUENTIAL   // a single pass over the file (e.g., a full table scan)
+	};
+
 	// ctor/dtor -- subclasses should handle big-5
 	DbFile(std::string name) : name(name) {}
 	virtual ~DbFile() {}
@@ -186,11 +287,11 @@ public:
 	virtual void put(DbBlock* block) = 0;
 
 	/**
-	 * Get a list of all the valid BlockID's in the file
-	 * FIXME - not a good long-term approach, but we'll do this until we put in iterators
-	 * @returns  a pointer to vector of BlockIDs (freed by caller)
-	 */ 
-	virtual BlockIDs* block_ids() const = 0;
+	 * Get the range of all the valid BlockID's in the file (as of now; blocks added during a
+	 * scan are not included).
+	 * @returns  the block ids, generated lazily
+	 */
+	virtual BlockRange blocks() const = 0;
 
 protected:
 	std::string name;  // filename (or part of it)
@@ -256,6 +357,111 @@ public:
 };
 
 
+/**
+ * Names of a row's columns, in order, shared by all the rows of a projection.
+ */
+typedef std::shared_ptr<const ColumnNames> RowSchema;
+
+/**
+ * @class Row - the values of a row in column order, with the names of its columns
+ *
+ * The values are one contiguous vector, and the names are not copied into each row but shared
+ * through its schema. Getting a value by ordinal is an index; getting one by name (or converting
+ * to a ValueDict) is a search of the schema, for code outside the per-row paths.
+ */
+class Row {
+public:
+	typedef std::vector<Value, ArenaAllocator<Value>> Values;
+
+	Row(RowSchema schema, Arena* arena=nullptr) :
+		schema(schema), values(schema->size(), Value(), ArenaAllocator<Value>(arena)) {}
+	Row(RowSchema schema, const ValueDict& values);
+	virtual ~Row() {}
+
+	/**
+	 * A new row, in the arena if there is one (which then owns it), else on the heap.
+	 * @param schema  names of its columns
+	 * @param arena   where to put it (or nullptr)
+	 * @returns       the row, with a default value for each column
+	 */
+	static Row* create(RowSchema schema, Arena* arena) {
+		return arena != nullptr ? arena->make<Row>(schema, arena) : new Row(schema);
+	}
+
+	/**
+	 * @returns  number of columns
+	 */
+	uint size() const {return (uint)values.size();}
+
+	/**
+	 * @returns  the names of the columns, in order
+	 */
+	const RowSchema& get_schema() const {return schema;}
+
+	Value& operator[](uint ordinal) {return values[ordinal];}
+	const Value& operator[](uint ordinal) const {return values[ordinal];}
+	Values::iterator begin() {return values.begin();}
+	Values::iterator end() {return values.end();}
+	Values::const_iterator begin() const {return values.begin();}
+	Values::const_iterator end() const {return values.end();}
+
+	/**
+	 * Find a column.
+	 * @param column_name  its name
+	 * @returns            its ordinal, or -1 if the row does not have it
+	 */
+	int ordinal(const Identifier& column_name) const;
+
+	bool has(const Identifier& column_name) const {return ordinal(column_name) >= 0;}
+
+	/**
+	 * Value of a column, by name (throws DbRelationError if the row does not have it).
+	 */
+	Value& operator[](const Identifier& column_name) {return at(column_name);}
+	Value& at(const Identifier& column_name);
+	const Value& at(const Identifier& column_name) const;
+
+	/**
+	 * @returns  the row as a dictionary keyed by column name
+	 */
+	ValueDict to_dict() const;
+
+protected:
+	RowSchema schema;
+	Values values;
+};
+
+typedef std::vector<Row*> Rows;
+
+class DataChunk;
+
+/**
+ * @class DbCursor - a selection's handles, handed out a batch at a time
+ *
+ * A cursor from DbRelation::cursor() reads only as far into the relation as the batches asked for so
+ * far, so the caller holds one batch of handles at a time rather than the whole selection, and has the
+ * first of them before the scan is done. Delete the cursor to stop early.
+ */
+class DbCursor {
+public:
+	virtual ~DbCursor() {}
+
+	/**
+	 * Get the next batch of handles.
+	 * @param handles  returned by reference: the batch (cleared first; never left empty unless there are no more)
+	 * @returns        false once the selection is used up
+	 */
+	virtual bool next(Handles& handles) = 0;
+
+	/**
+	 * Get the next batch of rows, decoded (from a cursor over some of the columns).
+	 * @param chunk  returned by reference: the rows (reset first; never left empty unless there are no more)
+	 * @returns      false once the selection is used up
+	 */
+	virtual bool next(DataChunk& chunk);
+};
+
+
 /**
  * @class DbRelation - top-level object handling a physical database relation
  * 
@@ -266,12 +472,19 @@ public:
  * 	
  * 	open()
  * 	close()
+ * 	checkpoint()
  * 	
  *	insert(row)
+ *	insert_many(rows)
+ *	pack(rows, blocks)
+ *	append_blocks(blocks)
  *	update(handle, new_values)
  *	del(handle)
  *	select()
  *	select(where)
+ *	select(where, hint)
+ *	cursor(where, hint)
+ *	cursor(where, columns, hint)
  *	project(handle)
  *	project(handle, column_names)
  */
@@ -311,6 +524,11 @@ public:
 	 */
 	virtual void close() = 0;
 
+	/**
+	 * Write out all the changes made to the table so far, leaving it open.
+	 */
+	virtual void checkpoint() {}
+
 	/**
 	 * Execute: INSERT INTO <table_name> ( <row_keys> ) VALUES ( <row_values> )
 	 * @param row  a dictionary keyed by column names
@@ -318,6 +536,28 @@ public:
 	 */
 	virtual Handle insert(const ValueDict* row) = 0;
 
+	/**
+	 * Execute: INSERT INTO <table_name> ( <row_keys> ) VALUES ( <row_values> ), ( <row_values> ), ...
+	 * @param rows  dictionaries keyed by column names
+	 * @returns     handles to the new rows, in the same order (freed by caller)
+	 */
+	virtual Handles* insert_many(const ValueDicts& rows);
+
+	/**
+	 * Lay rows out as complete block images for append_blocks(), without touching the relation's
+	 * file, so that several threads can pack rows for the same relation at once.
+	 * @param rows    dictionaries keyed by column names
+	 * @param blocks  returned by reference: DbBlock::BLOCK_SZ bytes each, allocated with new[] (freed by caller)
+	 */
+	virtual void pack(const ValueDicts& rows, std::vector<char*>& blocks) const;
+
+	/**
+	 * Add block images made by pack() to the end of the relation as they are (bulk load).
+	 * @param blocks  the block images (still owned by the caller)
+	 * @returns       handles to the rows in them, in order (freed by caller)
+	 */
+	virtual Handles* append_blocks(const std::vector<char*>& blocks);
+
 	/**
 	 * Conceptually, execute: UPDATE INTO <table_name> SET <new_valus> WHERE <handle>
 	 * where handle is sufficient to identify one specific record (e.g., returned
@@ -348,6 +588,17 @@ public:
 	 */
 	virtual Handles* select(const ValueDict* where) = 0;
 
+	/**
+	 * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+	 * This version lets the caller say how the scan will use the blocks it reads.
+	 * @param where  where-clause predicates (nullptr for all rows)
+	 * @param hint   DbFile::SEQUENTIAL for a one-time pass over a possibly large table
+	 * @returns      a pointer to a list of handles for qualifying rows (freed by caller)
+	 */
+	virtual Handles* select(const ValueDict* where, DbFile::AccessHint hint) {
+		return select(where);
+	}
+
 	/**
 	 * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
 	 * This version does a restricted selection based on current_selection.
@@ -357,35 +608,67 @@ public:
 	 */
 	virtual Handles* select(Handles* current_selection, const ValueDict* where) = 0;
 
+	/**
+	 * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+	 * This version gets the handles a batch at a time, as the caller pulls them. The default just
+	 * hands out all of select(where, hint) as one batch.
+	 * @param where  where-clause predicates (nullptr for all rows; must outlive the cursor)
+	 * @param hint   DbFile::SEQUENTIAL for a one-time pass over a possibly large table
+	 * @returns      the cursor (freed by caller)
+	 */
+	virtual DbCursor* cursor(const ValueDict* where, DbFile::AccessHint hint=DbFile::NORMAL);
+
+	/**
+	 * Conceptually, execute: SELECT <columns> FROM <table_name> WHERE <where>
+	 * This version decodes the rows as well, a DataChunk of the columns at a time (with next(chunk)),
+	 * for vectorized evaluation. Not every storage engine can.
+	 * @param where    where-clause predicates (nullptr for all rows)
+	 * @param columns  the columns wanted, in the order of the chunk's
+	 * @param hint     DbFile::SEQUENTIAL for a one-time pass over a possibly large table
+	 * @returns        the cursor (freed by caller)
+	 */
+	virtual DbCursor* cursor(const ValueDict* where, const ColumnNames& columns,
+							 DbFile::AccessHint hint=DbFile::NORMAL);
+
 	/**
 	 * Return a sequence of all values for handle (SELECT *).
 	 * @param handle  row to get values from
-	 * @returns       dictionary of values from row (keyed by all column names)
+	 * @returns       the row's values (all the columns, in order)
 	 */
-	virtual ValueDict* project(Handle handle) = 0;
+	virtual Row* project(Handle handle) = 0;
 
 	/**
 	 * Return a sequence of values for handle given by column_names 
 	 * (SELECT <column_names>).
 	 * @param handle        row to get values from
 	 * @param column_names  list of column names to project
-	 * @returns             dictionary of values from row (keyed by column_names)
+	 * @returns             the values of those columns (in that order)
+	 */
+	virtual Row* project(Handle handle, const ColumnNames* column_names);
+
+	/**
+	 * Same, with the column names already in the schema the rows will share (so a projection of
+	 * many rows copies the names once).
+	 * @param handle   row to get values from
+	 * @param columns  list of column names to project
+	 * @returns        the values of those columns (in that order)
 	 */
-	virtual ValueDict* project(Handle handle, const ColumnNames* column_names) = 0;
+	virtual Row* project(Handle handle, const RowSchema& columns) = 0;
 
 	/**
 	 * Return a sequence of values for handle given by column_names (from dictionary) 
 	 * (SELECT <column_names>).
 	 * @param handle        row to get values from
 	 * @param column_names  list of column names to project (taken from keys of dict)
-	 * @returns             dictionary of values from row (keyed by column_names)
+	 * @returns             the values of those columns
 	 */
-	virtual ValueDict* project(Handle handle, const ValueDict* column_names);
+	virtual Row* project(Handle handle, const ValueDict* column_names);
 
-	// additional versions of project for multiple rows
-	virtual ValueDicts* project(Handles *handles);
-	virtual ValueDicts* project(Handles *handles, const ColumnNames* column_names);
-	virtual ValueDicts* project(Handles *handles, const ValueDict* column_names);
+	// additional versions of project for multiple rows (built in the arena, if one is given, which then owns them)
+	virtual Rows* project(Handles *handles, Arena* arena=nullptr);
+	virtual Rows* project(Handles *handles, const ColumnNames* column_names, Arena* arena=nullptr);
+	virtual Rows* project(Handles *handles, const RowSchema& columns, Arena* arena=nullptr);
+	virtual Rows* project(Handles *handles, const ValueDict* column_names);
 
 	/**
 	 * Accessor for column_names.
@@ -412,6 +695,13 @@ public:
 	 */
 	virtual ColumnAttributes* get_column_attributes(const ColumnNames &select_column_names) const;
 
+	/**
+	 * Number of blocks the relation takes up (for cost estimates; 0 if it is not kept in blocks).
+	 */
+	virtual BlockID get_block_count() {
+		return 0;
+	}
+
 	/**
 	 * Accessor method for table_name
 	 * @returns  table_name
@@ -482,6 +772,15 @@ public:
 	 */
     virtual void insert(Handle record) = 0;
 
+	/**
+	 * Insert the index entries for a batch of records (e.g., from DbRelation::insert_many).
+	 * @param records  handles (into relation) to the records to insert
+	 */
+    virtual void insert(const Handles* records) {
+        for (auto const& record: *records)
+            insert(record);
+    }
+
 	/**
 	 * Delete the index entry for the given record.
 	 * @param record  handle (into relation) to the record to remove
@@ -489,6 +788,21 @@ public:
 	 */
     virtual void del(Handle record) = 0;
 
+	/**
+	 * Number of levels a lookup goes down through (for cost estimates).
+	 */
+    virtual uint get_height() {
+        return 1;
+    }
+
+    virtual Identifier get_name() const {
+        return name;
+    }
+
+    virtual bool is_unique() const {
+        return unique;
+    }
+
 protected:
     DbRelation& relation;
     Identifier name;